@@ -0,0 +1,610 @@
+/**
+ * copyright 2002-2004 Bryce "Zooko" Wilcox-O'Hearn
+ * mailto:zooko@zooko.com
+ *
+ * See the end of this file for the simple, permissive free software, open 
+ * source license.
+ *
+ * Rough timings of libzstr operations.  Run "make bench && ./bench" to run all 
+ * of them, or "./bench join" to run just the one named.  The default CFLAGS 
+ * in GNUmakefile are -O0, so switch to the optimizing CFLAGS line there before 
+ * believing any of the numbers.
+*/
+#include "zstr.h"
+#include "zpipe.h"
+#include "zwriter.h"
+#include "zdict.h"
+#include "zchunk.h"
+#include "zsha256.h"
+#include "zfilter.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+static double
+now()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void
+report(const char* name, double secs, size_t ops, size_t bytes)
+{
+	printf("%-32s %10.3f ms %12.0f ops/s %10.1f MB/s\n", name, secs * 1e3, ops / secs, bytes / secs / 1e6);
+}
+
+void bench_join()
+{
+	static const size_t piecelens[] = { 8, 64, 4096 };
+	const size_t npieces = 100000;
+	czstr* pieces;
+	zbyte* pool;
+	zstr z;
+	size_t i, j, k, plen;
+	double t;
+	char name[64];
+
+	pool = (zbyte*)malloc(4096 + 1);
+	CHECKMALLOCEXIT(pool);
+	memset(pool, 'x', 4096);
+	pool[4096] = '\0';
+	pieces = (czstr*)malloc(npieces * sizeof(czstr));
+	CHECKMALLOCEXIT(pieces);
+
+	for (j = 0; j < sizeof(piecelens)/sizeof(piecelens[0]); j++) {
+		plen = piecelens[j];
+		for (i = 0; i < npieces; i++) {
+			pieces[i] = (czstr){ plen, pool + 4096 - plen };
+		}
+
+		t = now();
+		z = (zstr){ 0, NULL };
+		for (i = 0; i < npieces; i++) {
+			z = zcat(z, pieces[i]);
+		}
+		t = now() - t;
+		sprintf(name, "zcat chain %lu x %lu", (unsigned long)npieces, (unsigned long)plen);
+		report(name, t, npieces, z.len);
+		free_z(z);
+
+		t = now();
+		z = zjoin(pieces, npieces, (czstr){ 0, NULL });
+		t = now() - t;
+		sprintf(name, "zjoin %lu x %lu", (unsigned long)npieces, (unsigned long)plen);
+		report(name, t, npieces, z.len);
+		free_z(z);
+
+		for (k = 2; k <= 4; k *= 2) {
+			t = now();
+			z = zjoin_parallel(pieces, npieces, (czstr){ 0, NULL }, k);
+			t = now() - t;
+			sprintf(name, "zjoin_parallel/%lu %lu x %lu", (unsigned long)k, (unsigned long)npieces, (unsigned long)plen);
+			report(name, t, npieces, z.len);
+			free_z(z);
+		}
+	}
+
+	free(pieces);
+	free(pool);
+}
+
+/**
+ * Build a log-like haystack of about len bytes in which "secret" appears 
+ * once every few lines.
+ */
+static zstr
+make_log(size_t len)
+{
+	static const char* const lines[] = {
+		"GET /index.html 200 user=alice\n",
+		"POST /login 302 user=bob secret=hunter2\n",
+		"GET /favicon.ico 404 user=-\n",
+		"GET /api/items?page=3 200 user=carol secret=swordfish\n",
+	};
+	zstr z = { 0, NULL };
+	size_t i = 0;
+	while (z.len < len) {
+		z = zcat(z, cs_as_cz(lines[i++ % 4]));
+	}
+	return z;
+}
+
+/** The naive approach: search, then zcat() the fragments together. */
+static zstr
+replace_by_zcat(czstr z, czstr needle, czstr repl)
+{
+	zstr result = { 0, NULL };
+	const zbyte* p = z.buf;
+	const zbyte* m;
+	while ((m = zfind((czstr){ z.buf + z.len - p, p }, needle)) != NULL) {
+		result = zcat(result, (czstr){ m - p, p });
+		result = zcat(result, repl);
+		p = m + needle.len;
+	}
+	return zcat(result, (czstr){ z.buf + z.len - p, p });
+}
+
+void bench_replace()
+{
+	const size_t len = 8 * 1024 * 1024;
+	czstr needles[3];
+	czstr repls[3];
+	zstr log = make_log(len);
+	zstr z;
+	double t;
+
+	needles[0] = cs_as_cz("secret="); repls[0] = cs_as_cz("XXXXXX=");
+	needles[1] = cs_as_cz("alice");   repls[1] = cs_as_cz("[user]");
+	needles[2] = cs_as_cz("bob");     repls[2] = cs_as_cz("[user]");
+
+	t = now();
+	z = replace_by_zcat(cz(log), needles[0], repls[0]);
+	t = now() - t;
+	report("replace by zcat 8MB", t, 1, log.len);
+	free_z(z);
+
+	t = now();
+	z = zreplace(cz(log), needles[0], repls[0]);
+	t = now() - t;
+	report("zreplace 8MB", t, 1, log.len);
+	free_z(z);
+
+	t = now();
+	z = zreplace_many(cz(log), needles, repls, 3);
+	t = now() - t;
+	report("zreplace_many 3 needles 8MB", t, 1, log.len);
+	free_z(z);
+
+	t = now();
+	log = zreplace_in_place(log, needles[0], cs_as_cz("s="));
+	t = now() - t;
+	report("zreplace_in_place 8MB", t, 1, len);
+	free_z(log);
+}
+
+/** Stand-in for real per-frame work: a cheap checksum of the frame. */
+static void
+sum_frame(void* ctx, czstr frame, size_t seq)
+{
+	size_t i;
+	unsigned sum = 0;
+	for (i = 0; i < frame.len; i++)
+		sum = sum * 31 + frame.buf[i];
+	if (sum == 0xdeadbeef)
+		(*(size_t*)ctx)++;
+}
+
+void bench_decode_pipeline()
+{
+	static const size_t nworkers[] = { 1, 2, 4, 8 };
+	const size_t nframes = 1000000;
+	const char* const path = "/tmp/zstr_bench_frames";
+	zbyte payload[200];
+	zpipe_opts opts;
+	size_t i, dummy = 0, bytes = 0;
+	FILE* fp;
+	zstr z;
+	double t;
+	char name[64];
+
+	for (i = 0; i < sizeof(payload); i++)
+		payload[i] = (zbyte)i;
+	fp = fopen(path, "w");
+	CHECKMALLOCEXIT(fp);
+	for (i = 0; i < nframes; i++) {
+		z_encode((czstr){ 20 + i % 180, payload }, fp);
+		bytes += 4 + 20 + i % 180;
+	}
+	fclose(fp);
+
+	fp = fopen(path, "r");
+	t = now();
+	for (i = 0; i < nframes; i++) {
+		z = z_decode(fp);
+		sum_frame(&dummy, cz(z), i);
+		free_z(z);
+	}
+	t = now() - t;
+	fclose(fp);
+	report("z_decode serial", t, nframes, bytes);
+
+	zpipe_default_opts(&opts);
+	for (i = 0; i < sizeof(nworkers)/sizeof(nworkers[0]); i++) {
+		opts.nworkers = nworkers[i];
+		opts.ordered = 0;
+		fp = fopen(path, "r");
+		t = now();
+		z_decode_pipeline(fp, &opts, sum_frame, &dummy);
+		t = now() - t;
+		fclose(fp);
+		sprintf(name, "z_decode_pipeline %lu workers", (unsigned long)nworkers[i]);
+		report(name, t, nframes, bytes);
+
+		opts.ordered = 1;
+		fp = fopen(path, "r");
+		t = now();
+		z_decode_pipeline(fp, &opts, sum_frame, &dummy);
+		t = now() - t;
+		fclose(fp);
+		sprintf(name, "  ... ordered");
+		report(name, t, nframes, bytes);
+	}
+	remove(path);
+}
+
+static void*
+drain(void* arg)
+{
+	char buf[65536];
+	int fd = *(int*)arg;
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+	return NULL;
+}
+
+/**
+ * Write nsmall 24-byte strings, with a 16 KiB string after every 1000th, to fd 
+ * with either cz_to_stream() or a zwriter.
+ */
+static void
+bench_writer_to(const char* what, int fd, int use_zwriter)
+{
+	const size_t nsmall = 2000000;
+	static zbyte big[16384];
+	const czstr small = cs_as_cz("0123456789abcdefghijklm\n");
+	zwriter* w = NULL;
+	zwriter_stats st;
+	FILE* fp = NULL;
+	size_t i, bytes = 0;
+	double t;
+	char name[64];
+
+	if (use_zwriter)
+		w = new_zwriter(fd, 65536, 0);
+	else
+		fp = fdopen(dup(fd), "w");
+
+	t = now();
+	for (i = 0; i < nsmall; i++) {
+		if (use_zwriter)
+			zw_write(w, small);
+		else
+			cz_to_stream(small, fp);
+		bytes += small.len;
+		if (i % 1000 == 0) {
+			if (use_zwriter)
+				zw_write(w, (czstr){ sizeof(big), big });
+			else
+				cz_to_stream((czstr){ sizeof(big), big }, fp);
+			bytes += sizeof(big);
+		}
+	}
+	if (use_zwriter) {
+		zw_flush(w);
+		st = zw_stats(w);
+		free_zwriter(w);
+	} else {
+		fclose(fp);
+	}
+	t = now() - t;
+
+	sprintf(name, "%s %s", use_zwriter ? "zwriter" : "cz_to_stream", what);
+	report(name, t, nsmall, bytes);
+	if (use_zwriter)
+		printf("%-32s %10llu syscalls\n", "", st.syscalls);
+}
+
+void bench_writer()
+{
+	const char* const path = "/tmp/zstr_bench_writer";
+	int use_zwriter, fd, pipefds[2];
+	pthread_t reader;
+
+	for (use_zwriter = 0; use_zwriter < 2; use_zwriter++) {
+		if (pipe(pipefds) != 0)
+			return;
+		pthread_create(&reader, NULL, drain, &pipefds[0]);
+		bench_writer_to("pipe", pipefds[1], use_zwriter);
+		close(pipefds[1]);
+		pthread_join(reader, NULL);
+		close(pipefds[0]);
+
+		fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0600);
+		bench_writer_to("file", fd, use_zwriter);
+		close(fd);
+	}
+	remove(path);
+}
+
+static int
+count_entry(void* ctx, czstr key, czstr value)
+{
+	(*(size_t*)ctx)++;
+	return 0;
+}
+
+void bench_dict()
+{
+	const size_t nkeys = 1000000;
+	const size_t nlookups = 1000000;
+	const char* const zpath = "/tmp/zstr_bench_encoded";
+	const char* const dpath = "/tmp/zstr_bench_dict";
+	const czstr value = cs_as_cz("0123456789abcdef0123456789abcdef");
+	zdict_builder* b;
+	zdict* d;
+	zstr* loaded;
+	czstr v;
+	char key[64];
+	size_t i, found, seen;
+	int pass;
+	unsigned long r = 12345;
+	FILE* fp;
+	double t;
+
+	fp = fopen(zpath, "w");
+	for (i = 0; i < nkeys; i++) {
+		sprintf(key, "user/%08lu/profile", (unsigned long)i);
+		z_encode(cs_as_cz(key), fp);
+		z_encode(value, fp);
+	}
+	fclose(fp);
+
+	fp = fopen(dpath, "w");
+	t = now();
+	b = new_zdict_builder(fp, 0);
+	for (i = 0; i < nkeys; i++) {
+		sprintf(key, "user/%08lu/profile", (unsigned long)i);
+		zdb_add(b, cs_as_cz(key), value);
+	}
+	zdb_finish(b);
+	fclose(fp);
+	t = now() - t;
+	report("zdict build 1M", t, nkeys, 0);
+
+	loaded = (zstr*)malloc(2 * nkeys * sizeof(zstr));
+	CHECKMALLOCEXIT(loaded);
+	fp = fopen(zpath, "r");
+	t = now();
+	for (i = 0; i < 2 * nkeys; i++)
+		loaded[i] = z_decode(fp);
+	t = now() - t;
+	fclose(fp);
+	report("load 1M with z_decode", t, nkeys, 0);
+	for (i = 0; i < 2 * nkeys; i++)
+		free_z(loaded[i]);
+	free(loaded);
+
+	t = now();
+	d = zdict_open(dpath);
+	t = now() - t;
+	report("zdict_open 1M", t, 1, 0);
+
+	/* The first pass takes the page faults of touching the mapping. */
+	for (pass = 0; pass < 2; pass++) {
+		found = 0;
+		t = now();
+		for (i = 0; i < nlookups; i++) {
+			r = r * 1103515245 + 12345;
+			/* Half of these keys are present. */
+			sprintf(key, "user/%08lu/profile", (r >> 8) % (2 * nkeys));
+			found += zdict_get(d, cs_as_cz(key), &v);
+		}
+		t = now() - t;
+		report(pass ? "zdict_get random, warm" : "zdict_get random, cold", t, nlookups, 0);
+		printf("%-32s %10.0f ns/lookup, %lu found\n", "", t / nlookups * 1e9, (unsigned long)found);
+	}
+
+	seen = 0;
+	t = now();
+	zdict_prefix(d, cs_as_cz("user/0012"), count_entry, &seen);
+	t = now() - t;
+	report("zdict_prefix 10000 entries", t, seen, 0);
+
+	zdict_close(d);
+	remove(zpath);
+	remove(dpath);
+}
+
+static void
+count_chunk(void* ctx, czstr chunk)
+{
+	(*(size_t*)ctx)++;
+}
+
+void bench_chunk()
+{
+	static const size_t nthreads[] = { 2, 4, 8 };
+	const size_t len = 256 * 1024 * 1024;
+	zchunk_params params;
+	zstr data;
+	size_t i, n;
+	unsigned long r = 1;
+	double t;
+	char name[64];
+
+	data = new_z(len);
+	for (i = 0; i < len; i++) {
+		r = r * 1103515245 + 12345;
+		data.buf[i] = (zbyte)(r >> 16);
+	}
+	zchunk_default_params(&params);
+
+	n = 0;
+	t = now();
+	zchunk_all(&params, cz(data), count_chunk, &n);
+	t = now() - t;
+	report("zchunk_all 256MB", t, n, len);
+
+	for (i = 0; i < sizeof(nthreads)/sizeof(nthreads[0]); i++) {
+		n = 0;
+		t = now();
+		zchunk_all_parallel(&params, cz(data), nthreads[i], count_chunk, &n);
+		t = now() - t;
+		sprintf(name, "zchunk_all_parallel %lu threads", (unsigned long)nthreads[i]);
+		report(name, t, n, len);
+	}
+	free_z(data);
+}
+
+void bench_sha256()
+{
+	static const size_t nthreads[] = { 1, 2, 4, 8 };
+	const size_t len = 256 * 1024 * 1024;
+	zbyte d[ZSHA256_LEN];
+	zstr data;
+	size_t i;
+	double t;
+	char name[64];
+
+	data = new_z(len);
+	for (i = 0; i < len; i++)
+		data.buf[i] = (zbyte)i;
+
+	t = now();
+	zsha256(cz(data), d);
+	t = now() - t;
+	report("zsha256 256MB", t, 1, len);
+
+	for (i = 0; i < sizeof(nthreads)/sizeof(nthreads[0]); i++) {
+		t = now();
+		ztree(cz(data), nthreads[i], d);
+		t = now() - t;
+		sprintf(name, "ztree 256MB %lu threads", (unsigned long)nthreads[i]);
+		report(name, t, 1, len);
+	}
+	free_z(data);
+}
+
+static void
+make_filter_keys(czstr* keys, char* pool, size_t n, const char* prefix)
+{
+	size_t i;
+	for (i = 0; i < n; i++) {
+		sprintf(pool + 24 * i, "%s/%08lu/profile", prefix, (unsigned long)i);
+		keys[i] = cs_as_cz(pool + 24 * i);
+	}
+}
+
+void bench_filter()
+{
+	static const double bpks[] = { 4, 6, 8, 10, 12, 16, 20 };
+	const size_t n = 4000000;
+	czstr* keys = (czstr*)malloc(n * sizeof(czstr));
+	czstr* absent = (czstr*)malloc(n * sizeof(czstr));
+	char* pool = (char*)malloc(24 * n);
+	char* apool = (char*)malloc(24 * n);
+	zbyte* res = (zbyte*)malloc(n);
+	zbloom* bf;
+	zxor* xf;
+	size_t i, j, fp, nthreads;
+	double t;
+	char name[64];
+
+	make_filter_keys(keys, pool, n, "user");
+	make_filter_keys(absent, apool, n, "gone");
+
+	printf("false-positive rate vs bits per key, %lu keys:\n", (unsigned long)n);
+	for (j = 0; j < sizeof(bpks)/sizeof(bpks[0]); j++) {
+		bf = zbloom_build(keys, n, bpks[j], 1);
+		zbloom_contains_many(bf, absent, n, res);
+		for (i = 0, fp = 0; i < n; i++)
+			fp += res[i];
+		printf("  zbloom %4.1f bits/key  %8.4f%%\n", bpks[j], 100.0 * fp / n);
+		zbloom_free(bf);
+	}
+	xf = zxor_build(keys, n, 1);
+	zxor_contains_many(xf, absent, n, res);
+	for (i = 0, fp = 0; i < n; i++)
+		fp += res[i];
+	printf("  zxor   %4.1f bits/key  %8.4f%%\n", 8 * 1.23, 100.0 * fp / n);
+	zxor_free(xf);
+
+	for (nthreads = 1; nthreads <= 4; nthreads *= 4) {
+		t = now();
+		bf = zbloom_build(keys, n, 10, nthreads);
+		t = now() - t;
+		sprintf(name, "zbloom build 4M %lu threads", (unsigned long)nthreads);
+		report(name, t, n, 0);
+		zbloom_free(bf);
+		t = now();
+		xf = zxor_build(keys, n, nthreads);
+		t = now() - t;
+		sprintf(name, "zxor build 4M %lu threads", (unsigned long)nthreads);
+		report(name, t, n, 0);
+		zxor_free(xf);
+	}
+
+	bf = zbloom_build(keys, n, 10, 1);
+	xf = zxor_build(keys, n, 1);
+	t = now();
+	for (i = 0, fp = 0; i < n; i++)
+		fp += zbloom_contains(bf, absent[i]);
+	t = now() - t;
+	report("zbloom_contains 4M", t, n, 0);
+	t = now();
+	zbloom_contains_many(bf, absent, n, res);
+	t = now() - t;
+	report("zbloom_contains_many 4M", t, n, 0);
+	t = now();
+	for (i = 0; i < n; i++)
+		fp += zxor_contains(xf, absent[i]);
+	t = now() - t;
+	report("zxor_contains 4M", t, n, 0);
+	t = now();
+	zxor_contains_many(xf, absent, n, res);
+	t = now() - t;
+	report("zxor_contains_many 4M", t, n, 0);
+	assert (fp < n);
+	zbloom_free(bf);
+	zxor_free(xf);
+
+	free(keys);
+	free(absent);
+	free(pool);
+	free(apool);
+	free(res);
+}
+
+int main(int argc, char** argv)
+{
+	const char* which = (argc > 1) ? argv[1] : NULL;
+
+	if ((which == NULL) || !strcmp(which, "join"))
+		bench_join();
+	if ((which == NULL) || !strcmp(which, "replace"))
+		bench_replace();
+	if ((which == NULL) || !strcmp(which, "decode"))
+		bench_decode_pipeline();
+	if ((which == NULL) || !strcmp(which, "writer"))
+		bench_writer();
+	if ((which == NULL) || !strcmp(which, "dict"))
+		bench_dict();
+	if ((which == NULL) || !strcmp(which, "chunk"))
+		bench_chunk();
+	if ((which == NULL) || !strcmp(which, "sha256"))
+		bench_sha256();
+	if ((which == NULL) || !strcmp(which, "filter"))
+		bench_filter();
+	return 0;
+}
+
+
+/**
+ * Copyright (c) 2002-2004 Bryce "Zooko" Wilcox-O'Hearn
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software to deal in this software without restriction, including
+ * without limitation the rights to use, modify, distribute, sublicense, and/or 
+ * sell copies of this software, and to permit persons to whom this software is 
+ * furnished to do so, provided that the above copyright notice and this 
+ * permission notice is included in all copies or substantial portions of this 
+ * software. THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED.
+ */
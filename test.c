@@ -6,9 +6,17 @@
  * source license.
 */
 #include "zstr.h"
+#include "zpipe.h"
+#include "zwriter.h"
+#include "zdict.h"
+#include "zchunk.h"
+#include "zsha256.h"
+#include "zfilter.h"
 
 #include <assert.h>
 #include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 int test_czstr_manual()
 {
@@ -95,6 +103,280 @@ int test_repr()
 	return 0;
 }
 
+int test_join()
+{
+	czstr parts[3];
+	czstr none = { 0, NULL };
+	zstr z;
+
+	parts[0] = cs_as_cz("a");
+	parts[1] = cs_as_cz("");
+	parts[2] = cs_as_cz("bcd");
+
+	z = zjoin(parts, 3, cs_as_cz(", "));
+	assert (z.len == 8);
+	assert (!strcmp((const char*)z.buf, "a, , bcd"));
+	free_z(z);
+
+	z = zjoin(parts, 3, none);
+	assert (zeq(cz(z), cs_as_cz("abcd")));
+	free_z(z);
+
+	z = zjoin(parts, 1, cs_as_cz(", "));
+	assert (zeq(cz(z), cs_as_cz("a")));
+	free_z(z);
+
+	z = zjoin(NULL, 0, cs_as_cz(", "));
+	assert ((z.len == 0) && (z.buf == NULL));
+
+	z = zcatn(4, parts[0], parts[1], parts[2], cs_as_cz("!"));
+	assert (!strcmp((const char*)z.buf, "abcd!"));
+	free_z(z);
+
+	/* The empty czstr that the library itself returns, as a piece. */
+	parts[1] = none;
+	z = zjoin(parts, 3, cs_as_cz("-"));
+	assert (zeq(cz(z), cs_as_cz("a--bcd")));
+	free_z(z);
+	z = zjoin(&none, 1, none);
+	assert ((z.len == 0) && (z.buf == NULL));
+	z = zcatn(3, none, parts[2], none);
+	assert (zeq(cz(z), cs_as_cz("bcd")));
+	free_z(z);
+
+	/* Big enough for zjoin_parallel() to really use up to 4 threads, with 
+	 * pieces of uneven lengths so that the shares split them anywhere. */
+	{
+		const size_t npieces = 640;
+		czstr* pieces;
+		zbyte* pool;
+		zstr z2;
+		size_t i, nthreads;
+
+		pool = (zbyte*)malloc(65536);
+		CHECKMALLOCEXIT(pool);
+		for (i = 0; i < 65536; i++)
+			pool[i] = (zbyte)(i * 7 + (i >> 8));
+		pieces = (czstr*)malloc(npieces * sizeof(czstr));
+		CHECKMALLOCEXIT(pieces);
+		for (i = 0; i < npieces; i++) {
+			if (i % 50 == 3)
+				pieces[i] = none;
+			else
+				pieces[i] = (czstr){ (i * 7919) % 65536, pool + (i * 131) % 256 };
+			if (pieces[i].len + (i * 131) % 256 > 65536)
+				pieces[i].len = 65536 - (i * 131) % 256;
+		}
+		z = zjoin(pieces, npieces, cs_as_cz("<->"));
+		assert (z.len > 16 * 1024 * 1024);
+		for (nthreads = 1; nthreads <= 4; nthreads++) {
+			z2 = zjoin_parallel(pieces, npieces, cs_as_cz("<->"), nthreads);
+			assert (zeq(cz(z2), cz(z)));
+			free_z(z2);
+		}
+		free_z(z);
+		z = zjoin(pieces, npieces, none);
+		z2 = zjoin_parallel(pieces, npieces, none, 3);
+		assert (zeq(cz(z2), cz(z)));
+		free_z(z2);
+		free_z(z);
+		z = zjoin_parallel(parts, 3, cs_as_cz("-"), 4);
+		assert (zeq(cz(z), cs_as_cz("a--bcd")));
+		free_z(z);
+		z = zjoin_parallel(NULL, 0, none, 4);
+		assert ((z.len == 0) && (z.buf == NULL));
+		free(pieces);
+		free(pool);
+	}
+	return 0;
+}
+
+/**
+ * zreplace_many() done the slow, obvious way, as a reference: at each 
+ * position try the needles in order.
+ */
+static zstr
+replace_many_slowly(czstr z, const czstr* needles, const czstr* repls, size_t n)
+{
+	zstr result = new_z(0);
+	size_t p = 0, i;
+	while (p < z.len) {
+		for (i = 0; i < n; i++) {
+			if ((needles[i].len <= z.len - p) && !memcmp(z.buf + p, needles[i].buf, needles[i].len))
+				break;
+		}
+		if (i < n) {
+			result = zcat(result, repls[i]);
+			p += needles[i].len;
+		} else {
+			result = zcat(result, (czstr){ 1, z.buf + p });
+			p++;
+		}
+	}
+	return result;
+}
+
+int test_replace()
+{
+	czstr needles[3];
+	czstr repls[3];
+	czstr none = { 0, NULL };
+	zstr z, z2, src;
+	size_t i;
+
+	src = new_z_from_cs("abcabd");
+	assert (zfind(cz(src), cs_as_cz("abd")) == src.buf + 3);
+	assert (zfind(cz(src), cs_as_cz("abe")) == NULL);
+	assert (zfind(cz(src), cs_as_cz("abcabdx")) == NULL);
+	free_z(src);
+
+	z = zreplace(cs_as_cz("aaa"), cs_as_cz("aa"), cs_as_cz("b"));
+	assert (!strcmp((const char*)z.buf, "ba"));
+	free_z(z);
+
+	z = zreplace(cs_as_cz("x.y.z"), cs_as_cz("."), cs_as_cz("::"));
+	assert (zeq(cz(z), cs_as_cz("x::y::z")));
+	free_z(z);
+
+	z = zreplace(cs_as_cz("abcabcdxabcd"), cs_as_cz("abcd"), cs_as_cz("-"));
+	assert (zeq(cz(z), cs_as_cz("abc-x-")));
+	free_z(z);
+
+	z = zreplace(cs_as_cz("nothing"), cs_as_cz("?"), cs_as_cz("!"));
+	assert (zeq(cz(z), cs_as_cz("nothing")));
+	free_z(z);
+
+	z = zreplace(cs_as_cz("abab"), cs_as_cz("ab"), cs_as_cz(""));
+	assert ((z.len == 0) && (z.buf == NULL));
+
+	needles[0] = cs_as_cz("cat"); repls[0] = cs_as_cz("dog");
+	needles[1] = cs_as_cz("ca");  repls[1] = cs_as_cz("X");
+	needles[2] = cs_as_cz("a");   repls[2] = cs_as_cz("AA");
+	z = zreplace_many(cs_as_cz("a cat cab"), needles, repls, 3);
+	assert (!strcmp((const char*)z.buf, "AA dog Xb"));
+	free_z(z);
+
+	z = new_z_from_cs("password=hunter2&password=x");
+	z = zreplace_in_place(z, cs_as_cz("password"), cs_as_cz("pw"));
+	assert (!strcmp((const char*)z.buf, "pw=hunter2&pw=x"));
+	assert (z.len == strlen((const char*)z.buf));
+
+	/* Deleting with the empty czstr { 0, NULL } as the replacement. */
+	z = zreplace_in_place(z, cs_as_cz("pw="), none);
+	assert (!strcmp((const char*)z.buf, "hunter2&x"));
+	free_z(z);
+	z = zreplace(cs_as_cz("a-b-c"), cs_as_cz("-"), none);
+	assert (zeq(cz(z), cs_as_cz("abc")));
+	free_z(z);
+	repls[1] = none;
+	z = zreplace_many(cs_as_cz("a cat cab"), needles, repls, 3);
+	assert (!strcmp((const char*)z.buf, "AA dog b"));
+	free_z(z);
+	/* A long subject full of near misses, so that matches fall everywhere 
+	 * relative to the 16-byte blocks of the vectorized search.  
+	 * zreplace_many() searches differently, so it serves as the reference. */
+	src = new_z(2000);
+	for (i = 0; i < src.len; i++)
+		src.buf[i] = "abc"[(i * 7 + i / 5) % 3];
+	needles[0] = cs_as_cz("abcab"); repls[0] = cs_as_cz("X");
+	needles[1] = cs_as_cz("zzzz");  repls[1] = cs_as_cz("Y");
+	z = zreplace(cz(src), needles[0], repls[0]);
+	z2 = zreplace_many(cz(src), needles, repls, 2);
+	assert (z.len < src.len);
+	assert (zeq(cz(z), cz(z2)));
+	free_z(z);
+	free_z(z2);
+	free_z(src);
+
+	/* zreplace_many() against the obvious way, with shared first bytes, a 
+	 * one-byte needle that shadows longer ones, a match running into the 
+	 * last byte, and then more prefixes than the vectorized screen takes. */
+	src = new_z(2003);
+	for (i = 0; i < src.len; i++)
+		src.buf[i] = "abcdefghijk"[(i * 7 + i / 5) % 11];
+	needles[0] = cs_as_cz("ahd");  repls[0] = cs_as_cz("1");
+	needles[1] = cs_as_cz("ah");   repls[1] = none;
+	needles[2] = cs_as_cz("d");    repls[2] = cs_as_cz("333");
+	for (i = 1; i <= 3; i++) {
+		z = zreplace_many(cz(src), needles, repls, i);
+		z2 = replace_many_slowly(cz(src), needles, repls, i);
+		assert (!zeq(cz(z), cz(src)));
+		assert (zeq(cz(z), cz(z2)));
+		free_z(z);
+		free_z(z2);
+	}
+	needles[0] = (czstr){ 2, src.buf + src.len - 2 };
+	z = zreplace_many(cz(src), needles, repls, 2);
+	z2 = replace_many_slowly(cz(src), needles, repls, 2);
+	assert (zeq(cz(z), cz(z2)));
+	free_z(z);
+	free_z(z2);
+	{
+		czstr many[11], manyrepls[11];
+		for (i = 0; i < 11; i++) {
+			many[i] = (czstr){ 2, src.buf + 5 * i };
+			manyrepls[i] = (czstr){ 1, (const zbyte*)"ABCDEFGHIJK" + i };
+		}
+		z = zreplace_many(cz(src), many, manyrepls, 11);
+		z2 = replace_many_slowly(cz(src), many, manyrepls, 11);
+		assert (z.len < src.len);
+		assert (zeq(cz(z), cz(z2)));
+		free_z(z);
+		free_z(z2);
+	}
+	free_z(src);
+
+	z = zreplace(none, cs_as_cz("-"), cs_as_cz("+"));
+	assert ((z.len == 0) && (z.buf == NULL));
+	z = zreplace_in_place((zstr){ 0, NULL }, cs_as_cz("-"), none);
+	assert ((z.len == 0) && (z.buf == NULL));
+	return 0;
+}
+
+int test_shared()
+{
+	szstr a, b, c, e;
+	zbyte* w;
+
+	a = new_sz(cs_as_cz("hello, world"));
+	assert (sz_refcount(a) == 1);
+	assert (a.buf[a.len] == '\0');
+
+	b = sz_slice(a, 7, 5);
+	assert (zeq(sz_as_cz(b), cs_as_cz("world")));
+	assert (b.buf == a.buf + 7);
+	assert (sz_refcount(a) == 2);
+
+	c = sz_ref(b);
+	assert (sz_refcount(c) == 3);
+	free_sz(a);
+	assert (sz_refcount(b) == 2);
+	assert (zeq(sz_as_cz(b), cs_as_cz("world")));
+
+	/* b is shared with c, so writing to it must copy first. */
+	w = sz_mut(&b);
+	assert (w != NULL);
+	assert (b.buf != c.buf);
+	assert (sz_refcount(b) == 1);
+	assert (sz_refcount(c) == 1);
+	w[0] = 'W';
+	assert (!strcmp((const char*)b.buf, "World"));
+	assert (zeq(sz_as_cz(c), cs_as_cz("world")));
+
+	/* Now b is unshared, so writing to it must not copy. */
+	assert (sz_mut(&b) == w);
+	free_sz(b);
+	free_sz(c);
+
+	a = sz_adopt_z(new_z_from_cs("adopted"));
+	assert (zeq(sz_as_cz(a), cs_as_cz("adopted")));
+	e = sz_slice(a, 3, 0);
+	assert ((e.len == 0) && (e.buf == NULL) && (sz_refcount(e) == 0));
+	free_sz(e);
+	free_sz(a);
+	return 0;
+}
+
 /** This test requires manual intervention to provide an appropriate file to read and write. */
 void test_stream()
 {
@@ -125,11 +407,486 @@ void test_encode()
 	printf("b.len = %d, b.buf = %s\n", b.len, b.buf);	
 }
 
+typedef struct {
+	size_t n;
+	char* seen;
+	size_t next; /* only used in ordered mode */
+} pipeline_check;
+
+static void
+check_frame(void* ctx, czstr frame, size_t seq)
+{
+	pipeline_check* pc = (pipeline_check*)ctx;
+	char expected[32];
+	assert (seq < pc->n);
+	sprintf(expected, "frame %lu", (unsigned long)seq);
+	assert (zeq(frame, cs_as_cz(seq % 7 ? expected : "")));
+	assert (!pc->seen[seq]);
+	pc->seen[seq] = 1;
+}
+
+static void
+check_frame_ordered(void* ctx, czstr frame, size_t seq)
+{
+	pipeline_check* pc = (pipeline_check*)ctx;
+	assert (seq == pc->next);
+	pc->next++;
+	check_frame(ctx, frame, seq);
+}
+
+void test_decode_pipeline()
+{
+	const size_t n = 5000;
+	char buf[32];
+	pipeline_check pc;
+	zpipe_opts opts;
+	size_t i;
+	FILE* fp;
+
+	fp = fopen("/tmp/zpipe_test", "w");
+	assert (fp != NULL);
+	for (i = 0; i < n; i++) {
+		sprintf(buf, "frame %lu", (unsigned long)i);
+		z_encode(cs_as_cz(i % 7 ? buf : ""), fp);
+	}
+	fclose(fp);
+
+	pc.n = n;
+	pc.seen = (char*)malloc(n);
+	zpipe_default_opts(&opts);
+	/* Small blocks and batches, so that lots of frames straddle blocks, and
+	 * short queues, down to the shortest allowed. */
+	opts.blocksize = 13;
+	opts.batchsize = 3;
+	for (opts.queuelen = 1; opts.queuelen <= 4; opts.queuelen *= 2) {
+		memset(pc.seen, 0, n);
+		opts.ordered = 0;
+		fp = fopen("/tmp/zpipe_test", "r");
+		assert (z_decode_pipeline(fp, &opts, check_frame, &pc) == n);
+		fclose(fp);
+		for (i = 0; i < n; i++)
+			assert (pc.seen[i]);
+
+		memset(pc.seen, 0, n);
+		pc.next = 0;
+		opts.ordered = 1;
+		fp = fopen("/tmp/zpipe_test", "r");
+		assert (z_decode_pipeline(fp, &opts, check_frame_ordered, &pc) == n);
+		fclose(fp);
+		assert (pc.next == n);
+	}
+
+	free(pc.seen);
+	remove("/tmp/zpipe_test");
+}
+
+void test_writer()
+{
+	zbyte big[3001]; /* zcat() wants a null-terminated argument */
+	zwriter* w;
+	zwriter_stats st;
+	zstr expected = { 0, NULL };
+	zstr got, dec;
+	size_t i;
+	FILE* fp;
+	int fd;
+
+	memset(big, 'B', sizeof(big) - 1);
+	big[sizeof(big) - 1] = '\0';
+	fd = open("/tmp/zwriter_test", O_WRONLY|O_CREAT|O_TRUNC, 0600);
+	assert (fd >= 0);
+	w = new_zwriter(fd, ZW_COPY_MAX, 0);
+	for (i = 0; i < 1000; i++) {
+		zw_write(w, cs_as_cz("small "));
+		expected = zcat(expected, cs_as_cz("small "));
+		if (i % 100 == 0) {
+			zw_write(w, (czstr){ sizeof(big) - 1, big });
+			expected = zcat(expected, (czstr){ sizeof(big) - 1, big });
+		}
+	}
+	zw_encode(w, cs_as_cz("framed"));
+	zw_sync(w);
+	st = zw_stats(w);
+	assert (st.bytes == expected.len + 4 + 6);
+	/* Far fewer system calls than strings written. */
+	assert (st.syscalls < 50);
+	free_zwriter(w);
+	close(fd);
+
+	fp = fopen("/tmp/zwriter_test", "r");
+	got = new_z(expected.len);
+	assert (fread(got.buf, 1, got.len, fp) == got.len);
+	assert (zeq(cz(got), cz(expected)));
+	dec = z_decode(fp);
+	assert (zeq(cz(dec), cs_as_cz("framed")));
+	fclose(fp);
+
+	free_z(dec);
+	free_z(got);
+	free_z(expected);
+	remove("/tmp/zwriter_test");
+}
+
+static int
+collect_keys(void* ctx, czstr key, czstr value)
+{
+	zstr* z = (zstr*)ctx;
+	*z = zcat(*z, key);
+	*z = zcat(*z, cs_as_cz("="));
+	*z = zcat(*z, value);
+	*z = zcat(*z, cs_as_cz(";"));
+	return 0;
+}
+
+void test_dict()
+{
+	static const char* const keys[] = {
+		"", "a", "apple", "applesauce", "apply", "apt", "b", "banana",
+		"band", "bandana", "bandwidth", "c",
+	};
+	const size_t nkeys = sizeof(keys)/sizeof(keys[0]);
+	zdict_builder* b;
+	zdict* d;
+	czstr v;
+	zstr z = { 0, NULL };
+	char val[16];
+	size_t i;
+	FILE* fp;
+
+	fp = fopen("/tmp/zdict_test", "w");
+	/* Three entries per block, so that lookups and prefixes cross blocks. */
+	b = new_zdict_builder(fp, 3);
+	for (i = 0; i < nkeys; i++) {
+		sprintf(val, "v%lu", (unsigned long)i);
+		zdb_add(b, cs_as_cz(keys[i]), cs_as_cz(val));
+	}
+	zdb_finish(b);
+	fclose(fp);
+
+	d = zdict_open("/tmp/zdict_test");
+	assert (d != NULL);
+	assert (zdict_size(d) == nkeys);
+	for (i = 0; i < nkeys; i++) {
+		sprintf(val, "v%lu", (unsigned long)i);
+		assert (zdict_get(d, cs_as_cz(keys[i]), &v));
+		assert (zeq(v, cs_as_cz(val)));
+	}
+	assert (!zdict_get(d, cs_as_cz("ap"), NULL));
+	assert (!zdict_get(d, cs_as_cz("applet"), NULL));
+	assert (!zdict_get(d, cs_as_cz("bandz"), NULL));
+	assert (!zdict_get(d, cs_as_cz("zzz"), NULL));
+
+	assert (zdict_prefix(d, cs_as_cz("appl"), collect_keys, &z) == 3);
+	assert (!strcmp((const char*)z.buf, "apple=v2;applesauce=v3;apply=v4;"));
+	free_z(z);
+	z = (zstr){ 0, NULL };
+	assert (zdict_prefix(d, cs_as_cz("band"), collect_keys, &z) == 3);
+	assert (!strcmp((const char*)z.buf, "band=v8;bandana=v9;bandwidth=v10;"));
+	free_z(z);
+	z = (zstr){ 0, NULL };
+	assert (zdict_prefix(d, cs_as_cz("bz"), collect_keys, &z) == 0);
+	assert (zdict_prefix(d, cs_as_cz(""), collect_keys, &z) == nkeys);
+	free_z(z);
+
+	zdict_close(d);
+	remove("/tmp/zdict_test");
+}
+
+typedef struct {
+	size_t n;
+	size_t ends[4096];
+	const zbyte* base;
+} chunk_record;
+
+static void
+record_chunk(void* ctx, czstr chunk)
+{
+	chunk_record* r = (chunk_record*)ctx;
+	size_t start = r->n ? r->ends[r->n - 1] : 0;
+	assert (r->n < 4096);
+	if (r->base != NULL)
+		assert (chunk.buf == r->base + start);
+	r->ends[r->n++] = start + chunk.len;
+}
+
+void test_chunk()
+{
+	const size_t len = 3 * 1024 * 1024;
+	static chunk_record serial, other;
+	zchunk_params params;
+	zstr data;
+	size_t i, nthreads, same;
+	unsigned long r = 1;
+	FILE* fp;
+
+	data = new_z(len);
+	for (i = 0; i < len; i++) {
+		r = r * 1103515245 + 12345;
+		data.buf[i] = (zbyte)(r >> 16);
+	}
+	zchunk_default_params(&params);
+
+	serial.n = 0;
+	serial.base = data.buf;
+	assert (zchunk_all(&params, cz(data), record_chunk, &serial) == serial.n);
+	assert (serial.ends[serial.n - 1] == len);
+	for (i = 0; i < serial.n; i++) {
+		size_t clen = serial.ends[i] - (i ? serial.ends[i-1] : 0);
+		assert (clen <= params.maxsize);
+		assert ((clen >= params.minsize) || (i == serial.n - 1));
+	}
+	/* Roughly avgsize on average. */
+	assert ((len / serial.n > params.avgsize / 2) && (len / serial.n < params.avgsize * 2));
+
+	for (nthreads = 2; nthreads <= 8; nthreads *= 2) {
+		other.n = 0;
+		other.base = data.buf;
+		assert (zchunk_all_parallel(&params, cz(data), nthreads, record_chunk, &other) == serial.n);
+		assert (!memcmp(other.ends, serial.ends, serial.n * sizeof(size_t)));
+	}
+
+	fp = tmpfile();
+	fwrite(data.buf, 1, len, fp);
+	rewind(fp);
+	other.n = 0;
+	other.base = NULL;
+	assert (zchunk_stream(&params, fp, record_chunk, &other) == serial.n);
+	assert (!memcmp(other.ends, serial.ends, serial.n * sizeof(size_t)));
+	fclose(fp);
+
+	/* Insert a byte near the start: boundaries after the first few move 
+	 * by exactly one. */
+	memmove(data.buf + 1001, data.buf + 1000, len - 1001);
+	data.buf[1000] = 'x';
+	other.n = 0;
+	other.base = data.buf;
+	zchunk_all(&params, cz(data), record_chunk, &other);
+	same = 0;
+	for (i = 0; i < other.n; i++) {
+		if ((i + 1 < serial.n) && (other.ends[i] == serial.ends[i] + 1))
+			same++;
+	}
+	assert (same >= serial.n - 4);
+
+	free_z(data);
+}
+
+static int
+digest_is(const zbyte d[ZSHA256_LEN], const char* hex)
+{
+	char buf[2 * ZSHA256_LEN + 1];
+	int i;
+	for (i = 0; i < ZSHA256_LEN; i++)
+		sprintf(buf + 2*i, "%02x", d[i]);
+	return !strcmp(buf, hex);
+}
+
+void test_sha256()
+{
+	static const struct { size_t len; const char* root; } trees[] = {
+		{ 0, "6e340b9cffb37a989ca544e6bb780a2c78901d3fb33738768511a30617afa01d" },
+		{ 100, "10dad890fe2c743710f9db3bd057dfeffb4e6bc451bc2b1b8dcad48ebc3967d0" },
+		{ ZTREE_LEAF, "fa8ec4bb89d043303dde7e79ada7786b45feab50a7ab4f6a7741deae4c1c6986" },
+		{ 5 * ZTREE_LEAF + 123, "392b65dc48a0fe68bb4a913c8a439019083c038f3f2c4e169c4de1a25e22dff1" },
+		{ 8 * ZTREE_LEAF, "605f1eb6991f97ea2eead61dde3a19f494a86332586ff20445c54269d3c0dca2" },
+	};
+	zbyte d[ZSHA256_LEN];
+	zsha256_ctx ctx;
+	ztree_ctx tctx;
+	zstr a, data;
+	size_t i, j, step, nthreads;
+
+	zsha256(cs_as_cz(""), d);
+	assert (digest_is(d, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"));
+	zsha256(cs_as_cz("abc"), d);
+	assert (digest_is(d, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"));
+	zsha256(cs_as_cz("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"), d);
+	assert (digest_is(d, "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"));
+
+	/* A million a's, fed in awkward pieces. */
+	a = new_z(1000000);
+	memset(a.buf, 'a', a.len);
+	zsha256_init(&ctx);
+	for (i = 0, step = 1; i < a.len; i += step, step = step * 3 % 1000 + 1)
+		zsha256_update(&ctx, (czstr){ MIN(step, a.len - i), a.buf + i });
+	zsha256_final(&ctx, d);
+	assert (digest_is(d, "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0"));
+	free_z(a);
+
+	data = new_z(8 * ZTREE_LEAF);
+	for (i = 0; i < data.len; i++)
+		data.buf[i] = (zbyte)(i * 7 % 251);
+	for (j = 0; j < sizeof(trees)/sizeof(trees[0]); j++) {
+		for (nthreads = 1; nthreads <= 4; nthreads++) {
+			ztree((czstr){ trees[j].len, data.buf }, nthreads, d);
+			assert (digest_is(d, trees[j].root));
+		}
+		ztree_init(&tctx);
+		for (i = 0, step = 1; i < trees[j].len; i += step, step = step * 7 % 300000 + 1)
+			ztree_update(&tctx, (czstr){ MIN(step, trees[j].len - i), data.buf + i });
+		ztree_final(&tctx, d);
+		assert (digest_is(d, trees[j].root));
+	}
+	free_z(data);
+}
+
+/**
+ * Fill keys[i] with "<prefix>%06lu" of i, in the 16-byte slots of pool.
+ */
+static void
+make_keys(czstr* keys, char* pool, size_t n, const char* prefix)
+{
+	size_t i;
+	for (i = 0; i < n; i++) {
+		sprintf(pool + 16 * i, "%s%06lu", prefix, (unsigned long)i);
+		keys[i] = cs_as_cz(pool + 16 * i);
+	}
+}
+
+/**
+ * @return the contents of the file at path
+ */
+static zstr
+slurp(const char* path)
+{
+	FILE* fp = fopen(path, "r");
+	zstr z;
+	fseek(fp, 0, SEEK_END);
+	z = new_z(ftell(fp));
+	rewind(fp);
+	assert (fread(z.buf, 1, z.len, fp) == z.len);
+	fclose(fp);
+	return z;
+}
+
+void test_filter()
+{
+	const size_t n = 20000;
+	czstr* keys = (czstr*)malloc(n * sizeof(czstr));
+	czstr* absent = (czstr*)malloc(n * sizeof(czstr));
+	char* pool = (char*)malloc(16 * n);
+	char* apool = (char*)malloc(16 * n);
+	zbyte* res = (zbyte*)malloc(n);
+	zbloom* bf;
+	zbloom* bf4;
+	zxor* xf;
+	zstr ser, ser4;
+	size_t i, fp;
+	FILE* f;
+
+	make_keys(keys, pool, n, "key");
+	make_keys(absent, apool, n, "absent");
+
+	assert (zhash64(cs_as_cz("a"), 0) != zhash64(cs_as_cz("a"), 1));
+	assert (zhash64(cs_as_cz("abcdefghi"), 0) != zhash64(cs_as_cz("abcdefghj"), 0));
+
+	/* Bloom: no false negatives, about the promised false positives, and
+	 * the same filter however many threads built it. */
+	bf = zbloom_build(keys, n, 10, 1);
+	for (i = 0; i < n; i++)
+		assert (zbloom_contains(bf, keys[i]));
+	zbloom_contains_many(bf, absent, n, res);
+	for (i = 0, fp = 0; i < n; i++) {
+		assert (res[i] == zbloom_contains(bf, absent[i]));
+		fp += res[i];
+	}
+	assert (fp < n / 50);
+
+	f = fopen("/tmp/zfilter_test", "w");
+	zbloom_write(bf, f);
+	fclose(f);
+	ser = slurp("/tmp/zfilter_test");
+	bf4 = zbloom_build(keys, n, 10, 4);
+	f = fopen("/tmp/zfilter_test", "w");
+	zbloom_write(bf4, f);
+	fclose(f);
+	ser4 = slurp("/tmp/zfilter_test");
+	assert (zeq(cz(ser), cz(ser4)));
+	zbloom_free(bf4);
+	free_z(ser4);
+
+	bf4 = zbloom_open("/tmp/zfilter_test");
+	assert (bf4 != NULL);
+	zbloom_contains_many(bf4, keys, n, res);
+	for (i = 0; i < n; i++)
+		assert (res[i]);
+	for (i = 0; i < n; i++)
+		assert (zbloom_contains(bf4, absent[i]) == zbloom_contains(bf, absent[i]));
+	zbloom_free(bf4);
+	assert (zxor_open("/tmp/zfilter_test") == NULL);
+	assert (zbloom_view((czstr){ ser.len - 1, ser.buf }) == NULL);
+	zbloom_free(bf);
+	free_z(ser);
+
+	bf = zbloom_build(keys, 0, 10, 1);
+	assert (!zbloom_contains(bf, keys[0]));
+	zbloom_free(bf);
+
+	/* The empty key gets as many independent bits as any other, so it is 
+	 * no likelier to be a false positive. */
+	for (i = 0, fp = 0; i < 100; i++) {
+		bf = zbloom_build(keys + i * 200, 200, 10, 1);
+		fp += zbloom_contains(bf, cs_as_cz(""));
+		zbloom_free(bf);
+	}
+	assert (fp < 6);
+
+	/* Xor: the same again, with some duplicate keys thrown in. */
+	keys[n - 1] = keys[0];
+	keys[n - 2] = keys[1];
+	xf = zxor_build(keys, n, 4);
+	for (i = 0; i < n; i++)
+		assert (zxor_contains(xf, keys[i]));
+	zxor_contains_many(xf, absent, n, res);
+	for (i = 0, fp = 0; i < n; i++) {
+		assert (res[i] == zxor_contains(xf, absent[i]));
+		fp += res[i];
+	}
+	assert (fp < n / 100);
+
+	f = fopen("/tmp/zfilter_test", "w");
+	zxor_write(xf, f);
+	fclose(f);
+	zxor_free(xf);
+	ser = slurp("/tmp/zfilter_test");
+	xf = zxor_view(cz(ser));
+	assert (xf != NULL);
+	zxor_contains_many(xf, keys, n, res);
+	for (i = 0; i < n; i++)
+		assert (res[i]);
+	zxor_free(xf);
+	assert (zbloom_view(cz(ser)) == NULL);
+	free_z(ser);
+	remove("/tmp/zfilter_test");
+
+	xf = zxor_build(keys, 0, 1);
+	zxor_contains_many(xf, absent, 1000, res);
+	for (i = 0, fp = 0; i < 1000; i++)
+		fp += res[i];
+	assert (fp < 20);
+	zxor_free(xf);
+
+	free(keys);
+	free(absent);
+	free(pool);
+	free(apool);
+	free(res);
+}
+
 int main(int argv, char**argc)
 {
 	/*test_czstr();*/
 	/*test_stream();*/
 	test_encode();
+	test_join();
+	test_replace();
+	test_shared();
+	test_decode_pipeline();
+	test_writer();
+	test_dict();
+	test_chunk();
+	test_sha256();
+	test_filter();
 	return test_repr();
 }
 
@@ -0,0 +1,353 @@
+/**
+ * copyright 2002-2004 Bryce "Zooko" Wilcox-O'Hearn
+ * mailto:zooko@zooko.com
+ *
+ * See the end of this file for the simple, permissive free software, open
+ * source license.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+
+#include "moreassert.h"
+
+#include "zchunk.h"
+#include "zinternal.h"
+
+/**
+ * 256 random 64-bit numbers, one per byte value.  (These are the first 256
+ * outputs of splitmix64 seeded with 0x7a737472.)  Changing them changes
+ * every chunk boundary, so don't.
+ */
+static const uint64_t GEAR[256] = {
+	0x16a46f1e1e38bdb5ULL, 0xb3bb82d6075618edULL, 0x50dc01e2635b2518ULL, 0xa16e121ab81269b1ULL,
+	0xe07f82ef7ece6abbULL, 0x62c5bdb8ab90b16bULL, 0xea093fe498ccccf9ULL, 0xa7e0faf59efecb38ULL,
+	0x117d4a3557933472ULL, 0x40faf0f186d06de8ULL, 0x96ea130aad13875fULL, 0x194dfb9f3463b12aULL,
+	0x8ee8e6533cac78d5ULL, 0x0998ee2ea6b1ce01ULL, 0x4328953537b318b5ULL, 0xdbfa2804b4293c9aULL,
+	0x60303e16b7409979ULL, 0x8727b08bc2e76951ULL, 0xa1b81bc0b5915451ULL, 0x9c6307bb21c96b49ULL,
+	0x3e8fcad4518cdd57ULL, 0xc945b6bf9eef65e7ULL, 0x66254bcf050d937eULL, 0xbc9b43e965b5ef43ULL,
+	0x8f71197f8fbde354ULL, 0x3ddf1653bac20be5ULL, 0x3613ac90a4f17af7ULL, 0x186d7cc047c8378cULL,
+	0x88b9684c25239758ULL, 0xb19627c46802f003ULL, 0xc21438f2522cc227ULL, 0xf7e86535937c4c16ULL,
+	0x89504ca6a029ff8cULL, 0xadd08123ddef1e5cULL, 0xba89151fc9e813f3ULL, 0x5efb9592616fa988ULL,
+	0xd7100b1a25a63012ULL, 0xc3703dd5d908a552ULL, 0x8d4d40b51e89fe81ULL, 0x1ad8dd3d028e468eULL,
+	0x480662034f91d291ULL, 0x1f57381d5d7ba7b1ULL, 0xb020d813acaeae65ULL, 0x0e2ad11d6837b453ULL,
+	0xe249cadfe642196fULL, 0xa476ccaf2bb9bbd3ULL, 0xd753fd6122a79c9bULL, 0x05ad356b9a9740d6ULL,
+	0x798c219e98fe99cdULL, 0x4dbfd3690bf4b11bULL, 0x03311ae88218dab8ULL, 0x0b855ceb7e0a8b53ULL,
+	0x40ead60afcce4228ULL, 0xea07e59bad5cbb74ULL, 0x0bfef75cb49526efULL, 0x21e7c26eaad61e00ULL,
+	0x0ac783f4b92d2107ULL, 0x684c43a06710863eULL, 0x71ce466158f10c8bULL, 0x21c75f4e8ac55f4dULL,
+	0xd9c4c0501ea49ec6ULL, 0xdf8fbb827fc4d124ULL, 0xd0c27e9c0aa52824ULL, 0x7ef08d50b10f5e38ULL,
+	0xc59693af687b15e6ULL, 0xefedfb06ae4c6f01ULL, 0xf419862cb116baf5ULL, 0x4f89615bde02048aULL,
+	0xdf667bcb67ad595dULL, 0x424403c5ee6719e2ULL, 0xae5238087091d52cULL, 0xd3a14f7b2417d1ccULL,
+	0x5d91a3c309c5f404ULL, 0x0a4b5dc4f22d0452ULL, 0xd064fe4ed03761ccULL, 0x41da62b9285588afULL,
+	0x1190607f36e65a62ULL, 0x5bf7feac9a3d13c8ULL, 0x59b97c326f77b8e8ULL, 0xc784105bcb18ff04ULL,
+	0x94601e5aef99542cULL, 0x74bb60496bbaa7fcULL, 0x4250744a25583cfcULL, 0xae004422c8416d88ULL,
+	0x0194c01313fd8b42ULL, 0xee6ad985117bee24ULL, 0x52827ed785deee42ULL, 0x7deb05ea39e83602ULL,
+	0xd5d6bf3d272efc03ULL, 0x11d3802605dd227eULL, 0x5ba87b84e4b6c08fULL, 0x24c3472c793b1fe4ULL,
+	0x5ff6eeaec3049f29ULL, 0x8af08b60d5fe412bULL, 0x254acf21707dbec0ULL, 0x2c79005c9e2c362aULL,
+	0x1718cae97f3f9cf4ULL, 0xaebce2ded9d5db70ULL, 0x6c34b7dbbca708a3ULL, 0x58b44d24c7d70b16ULL,
+	0xbe9a48b8a5a31383ULL, 0x5cb869e404ebad25ULL, 0x30f2d0252520fea3ULL, 0xc06d15fa3e6d2d2cULL,
+	0x5cdab604828a8b2dULL, 0x9fc7ea481789f9c5ULL, 0x13bc3f3cd5ceeba5ULL, 0x6670b38c3b7aad85ULL,
+	0x6e7bce30de095ad6ULL, 0xdd172dc71c7b93fcULL, 0x25dd0f4ece6a141bULL, 0x467b66c752e64a38ULL,
+	0x01e19eed3ba2095cULL, 0x797144c9a6ad8129ULL, 0xce46d62082a0624cULL, 0x69e7f7671ce45963ULL,
+	0x19c8e6c4b3dc48e5ULL, 0x9c3c051ca3128311ULL, 0xaa498a75cf7379e9ULL, 0x3876a55158f4a137ULL,
+	0x6a2199096f110fffULL, 0x866ab85624d3a6daULL, 0xf47f628438fb8785ULL, 0x2c612fc5606badcdULL,
+	0x8098d41fdb93a043ULL, 0x40ca9809afd2a245ULL, 0x948eeb5c5f833546ULL, 0x86e0669f7351bf54ULL,
+	0xee9bf6eb4ccf5a53ULL, 0xba8a948b6b1abd97ULL, 0xb834744a534d4f5fULL, 0x6472ee3c8755c31cULL,
+	0x2c3ae22cac8bc421ULL, 0x4bc3fe3c456810c6ULL, 0x41157889834de264ULL, 0xa0aa2bba91486119ULL,
+	0x778f8b7695dd1fcaULL, 0xc0bcc0a5d42b3d7bULL, 0x5bfe2bb65eef8418ULL, 0x614f10e47a852d1dULL,
+	0xb05988bd8752e80eULL, 0x05920387e761d4d8ULL, 0x15d942020f45e91aULL, 0x7cd1b264ee234597ULL,
+	0xde7f71715100bf7fULL, 0xa0262640383b5d55ULL, 0x2004eb86312b5595ULL, 0x5f03766d798e2776ULL,
+	0x87c207444414cf55ULL, 0x809b5d9a2eed1959ULL, 0x18d314259cd1aa0dULL, 0x8cded2b8707b38a0ULL,
+	0x940464e628f5cab8ULL, 0x480afb6a06228640ULL, 0x0f8c1ff63cf90a54ULL, 0x38f9ce1cbad51773ULL,
+	0xe7c765c47dac2cd9ULL, 0xb86570bfb9d4e168ULL, 0xedf51d5ce54a414dULL, 0xaa53092230be5969ULL,
+	0x696eb1df0c94fab8ULL, 0x20f691f420d67869ULL, 0xeb0e5d9230187504ULL, 0x8f3b1f8a20083cdcULL,
+	0x5c9bd2934fbbe5daULL, 0x2789b9453d47aa42ULL, 0x63f06b64deab1810ULL, 0xc28fbc9dc9f7bc42ULL,
+	0x01ace35a90199618ULL, 0xe418e955aa02d008ULL, 0x9cb7ee6fcf472537ULL, 0xc6a6dc25687586acULL,
+	0x93aa80f5342a2874ULL, 0x96e506f9eeddd084ULL, 0x702f53a208b90070ULL, 0x68ec7bac7aa87bbeULL,
+	0xb51ef3e2ff360114ULL, 0xd6ba983e77979c55ULL, 0x91126fbb2ea0b762ULL, 0xe9b12a2a27c11bf1ULL,
+	0x1c2452be00c17314ULL, 0x84bf3cbfc1ad3136ULL, 0x4a17456a6644280dULL, 0xddb020fac33b613aULL,
+	0xdac14ddaf2d6a7ccULL, 0x8ef5eedbd3c9fe61ULL, 0xd1a932e02af7ef43ULL, 0x1bf0d54f594a0fc3ULL,
+	0x163275e96a986780ULL, 0xde1a0710d614b86fULL, 0x697bf41e4fc37940ULL, 0x3472df6423546a72ULL,
+	0x3c03469352809a62ULL, 0xeded9074e51d7bcfULL, 0x98336fc2478289bcULL, 0xf80beb7f339c2380ULL,
+	0x5453ddc7951ae1adULL, 0x797b0fcc826bc0dcULL, 0x3749d1a0201c0259ULL, 0x69699eded121dfd2ULL,
+	0xfc1baf7a02e408c5ULL, 0x20da7e5c135c55ffULL, 0xf21efe5175f7af4eULL, 0xf5d1b592969b0777ULL,
+	0x7e03ad9895bcc827ULL, 0x6d1e7b36ca7b877aULL, 0xd9879f7fa823f96eULL, 0x524e7643f5b94b39ULL,
+	0xc991d265a2f4e1c4ULL, 0xd80d0bfb2c25ebffULL, 0x814bb592302ad206ULL, 0x39ad045663a92dcaULL,
+	0xfcb57d41432a8cffULL, 0x1adcff1e02eec87eULL, 0x3a9b7e1e93f68314ULL, 0x62df10f350b02798ULL,
+	0x74e14346fe910f41ULL, 0x255d0a55c20e9df3ULL, 0x04855b6bc8a3c2e2ULL, 0x6b85802973ba282dULL,
+	0xd566f6d02e021ac3ULL, 0x8beb47f7fcaa8ec0ULL, 0xd0d0e680af222625ULL, 0x9ddb1dda560e1c5bULL,
+	0x86b044cd1f3cbb93ULL, 0x0b1833ff6b738595ULL, 0x909eec37a744552bULL, 0xb3afda5a0260d82fULL,
+	0x74cdd741e37b0731ULL, 0xdf7325bfd9202658ULL, 0x7a921f314b3a47c5ULL, 0x31871e03e3756984ULL,
+	0x731a9ce10add5f34ULL, 0x1098ee5583ac8a46ULL, 0x4ca5121466f2c615ULL, 0x35c210c5718d6dabULL,
+	0x9b8f7bf194481556ULL, 0x6bcda86ef080928fULL, 0x3dce2c718dce918fULL, 0x906eacb946c51ea7ULL,
+	0x0cb8d58c29af63c7ULL, 0xe2aa0460c92b85a1ULL, 0x631980ec4da7a1adULL, 0x3880b599a073087bULL,
+	0x884d5768aa9ec7adULL, 0x0d6230535b2066c1ULL, 0x3857113da7a81bc4ULL, 0x08fdad8b4e75097bULL,
+	0x52f657e40c5486a1ULL, 0x689b69dda0a7382fULL, 0x568a8bda9598c131ULL, 0x57f43477244e6d2aULL,
+	0xd490d28e1e3c17bfULL, 0x00f359248a1a9dc4ULL, 0x8554ece063a3c421ULL, 0x39fcb2a9b937c5e1ULL
+};
+
+void
+zchunk_default_params(zchunk_params*const params)
+{
+	assert (params != NULL); /* @precondition */
+	params->minsize = 2 * 1024;
+	params->avgsize = 8 * 1024;
+	params->maxsize = 64 * 1024;
+}
+
+/**
+ * @return a mask of the top n bits.  Because the gear hash shifts left once
+ *     per byte, the top bits depend on the last 64 bytes, whereas the bottom
+ *     n bits would depend on only the last n.
+ */
+static uint64_t
+top_bits(const unsigned n)
+{
+	return ~(uint64_t)0 << (64 - n);
+}
+
+size_t
+zchunk_cut(const zchunk_params*const params, const czstr data)
+{
+	const zbyte*const buf = data.buf;
+	size_t normal, n = data.len;
+	const zbyte* p;
+	uint64_t fp = 0, mid, g0, g1;
+	uint64_t masks, maskl;
+	unsigned bits = 0;
+	assert (params != NULL); /* @precondition */
+	assert (params->minsize < params->avgsize); /* @precondition */
+	assert (params->avgsize < params->maxsize); /* @precondition */
+	assert ((params->avgsize & (params->avgsize - 1)) == 0); /* @precondition */
+
+	if (n <= params->minsize)
+		return n;
+	if (n > params->maxsize)
+		n = params->maxsize;
+	normal = (n < params->avgsize) ? n : params->avgsize;
+
+	while (((size_t)1 << bits) < params->avgsize)
+		bits++;
+	/* Normalized chunking: two more bits than avgsize wants until avgsize, 
+	 * two fewer after. */
+	masks = top_bits(bits + 2);
+	maskl = top_bits((bits > 2) ? bits - 2 : 1);
+
+	/* The hash after the next two bytes is (fp << 2) + ((g0 << 1) + g1), 
+	 * where only the first term depends on fp, so GEAR_STEP2 advances it two 
+	 * bytes with one dependent operation and computes the hash in between 
+	 * on the side.  That chain of dependent operations, not the number of 
+	 * instructions, is what limits the speed of the one-byte-at-a-time loop.
+	 * The boundaries are exactly the same either way. */
+#define GEAR_STEP2(mask) \
+	do { \
+		g0 = GEAR[p[0]]; \
+		g1 = GEAR[p[1]]; \
+		mid = (fp << 1) + g0; \
+		fp = (fp << 2) + ((g0 << 1) + g1); \
+		p += 2; \
+		if (!(mid & (mask))) \
+			return p - 1 - buf; \
+		if (!(fp & (mask))) \
+			return p - buf; \
+	} while (0)
+#define GEAR_STEP(mask) \
+	do { \
+		fp = (fp << 1) + GEAR[*p++]; \
+		if (!(fp & (mask))) \
+			return p - buf; \
+	} while (0)
+
+	p = buf + params->minsize;
+	while ((size_t)(buf + normal - p) >= 8) {
+		GEAR_STEP2(masks);
+		GEAR_STEP2(masks);
+		GEAR_STEP2(masks);
+		GEAR_STEP2(masks);
+	}
+	while (p < buf + normal)
+		GEAR_STEP(masks);
+	while ((size_t)(buf + n - p) >= 8) {
+		GEAR_STEP2(maskl);
+		GEAR_STEP2(maskl);
+		GEAR_STEP2(maskl);
+		GEAR_STEP2(maskl);
+	}
+	while (p < buf + n)
+		GEAR_STEP(maskl);
+#undef GEAR_STEP2
+#undef GEAR_STEP
+	return n;
+}
+
+size_t
+zchunk_all(const zchunk_params*const params, const czstr data, const zchunk_fn fn, void*const ctx)
+{
+	size_t pos = 0, len, n = 0;
+	assert (fn != NULL); /* @precondition */
+	while (pos < data.len) {
+		len = zchunk_cut(params, (czstr){ data.len - pos, data.buf + pos });
+		fn(ctx, (czstr){ len, data.buf + pos });
+		pos += len;
+		n++;
+	}
+	return n;
+}
+
+size_t
+zchunk_stream(const zchunk_params*const params, FILE*const fp, const zchunk_fn fn, void*const ctx)
+{
+	const size_t bufsize = 4 * params->maxsize;
+	zbyte* buf;
+	size_t start = 0, end = 0, res, len, n = 0;
+	int eof = 0;
+	assert (fp != NULL); /* @precondition */
+	assert (fn != NULL); /* @precondition */
+
+	buf = (zbyte*)malloc(bufsize);
+	CHECKMALLOCEXIT(buf);
+	for (;;) {
+		/* Cut only where zchunk_cut() sees either a whole maxsize or the real 
+		 * end of the input, so that the chunks are the same as zchunk_all()'s. */
+		while ((end - start >= params->maxsize) || (eof && (end > start))) {
+			len = zchunk_cut(params, (czstr){ end - start, buf + start });
+			fn(ctx, (czstr){ len, buf + start });
+			start += len;
+			n++;
+		}
+		if (eof)
+			break;
+		memmove(buf, buf + start, end - start);
+		end -= start;
+		start = 0;
+		res = fread(buf + end, sizeof(zbyte), bufsize - end, fp);
+		runtime_assert(!ferror(fp), "file error");
+		end += res;
+		eof = feof(fp);
+	}
+	free(buf);
+	return n;
+}
+
+   /** parallel chunking */
+
+typedef struct {
+	size_t* v;
+	size_t n;
+	size_t cap;
+} cutlist;
+
+static void
+cl_push(cutlist*const cl, const size_t cut)
+{
+	if (cl->n == cl->cap) {
+		cl->cap = cl->cap ? 2 * cl->cap : 1024;
+		cl->v = (size_t*)realloc(cl->v, cl->cap * sizeof(size_t));
+		CHECKMALLOCEXIT(cl->v);
+	}
+	cl->v[cl->n++] = cut;
+}
+
+/**
+ * One thread's share of the data: it chunks from start as though start were
+ * a boundary, until it has found a boundary at or past stop.
+ */
+typedef struct {
+	const zchunk_params* params;
+	czstr data;
+	size_t start;
+	size_t stop;
+	cutlist cuts;
+} share;
+
+static void*
+chunk_share(void*const arg)
+{
+	share*const s = (share*)arg;
+	size_t pos = s->start;
+	while (pos < s->data.len) {
+		pos += zchunk_cut(s->params, (czstr){ s->data.len - pos, s->data.buf + pos });
+		cl_push(&s->cuts, pos);
+		if (pos >= s->stop)
+			break;
+	}
+	return NULL;
+}
+
+size_t
+zchunk_all_parallel(const zchunk_params*const params, const czstr data, size_t nthreads, const zchunk_fn fn, void*const ctx)
+{
+	share* shares;
+	cutlist all;
+	cutlist* l;
+	size_t i, j, k, cur, prev;
+	assert (fn != NULL); /* @precondition */
+
+	/* Below a few chunks per thread there is nothing to gain. */
+	if (nthreads > data.len / (4 * params->maxsize))
+		nthreads = data.len / (4 * params->maxsize);
+	if (nthreads <= 1)
+		return zchunk_all(params, data, fn, ctx);
+
+	shares = (share*)malloc(nthreads * sizeof(share));
+	CHECKMALLOCEXIT(shares);
+	for (k = 0; k < nthreads; k++) {
+		shares[k].params = params;
+		shares[k].data = data;
+		shares[k].start = data.len / nthreads * k;
+		shares[k].stop = (k + 1 == nthreads) ? data.len : data.len / nthreads * (k + 1);
+		shares[k].cuts = (cutlist){ NULL, 0, 0 };
+	}
+	z_run_shares(chunk_share, shares, sizeof(share), nthreads);
+
+	/* Share 0 really does start at a boundary, so all of its cuts are real.  
+	 * Each later share's cuts become real from the first one that the real 
+	 * chain lands on; until then, follow the chain ourselves. */
+	all = shares[0].cuts;
+	for (k = 1; k < nthreads; k++) {
+		l = &shares[k].cuts;
+		cur = all.v[all.n - 1];
+		j = 0;
+		while (cur < data.len) {
+			while ((j < l->n) && (l->v[j] < cur))
+				j++;
+			if (j == l->n)
+				break; /* past this share altogether */
+			if (l->v[j] == cur) {
+				for (j++; j < l->n; j++)
+					cl_push(&all, l->v[j]);
+				break;
+			}
+			cur += zchunk_cut(params, (czstr){ data.len - cur, data.buf + cur });
+			cl_push(&all, cur);
+		}
+		free(l->v);
+	}
+	assert (all.v[all.n - 1] == data.len); /* error internal to this function */
+
+	prev = 0;
+	for (i = 0; i < all.n; i++) {
+		fn(ctx, (czstr){ all.v[i] - prev, data.buf + prev });
+		prev = all.v[i];
+	}
+
+	i = all.n;
+	free(all.v);
+	free(shares);
+	return i;
+}
+
+/**
+ * Copyright (c) 2002-2004 Bryce "Zooko" Wilcox-O'Hearn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software to deal in this software without restriction, including
+ * without limitation the rights to use, modify, distribute, sublicense, and/or
+ * sell copies of this software, and to permit persons to whom this software is
+ * furnished to do so, provided that the above copyright notice and this
+ * permission notice is included in all copies or substantial portions of this
+ * software. THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED.
+ */
@@ -0,0 +1,113 @@
+/**
+ * copyright 2002-2004 Bryce "Zooko" Wilcox-O'Hearn
+ * mailto:zooko@zooko.com
+ *
+ * See the end of this file for the simple, permissive free software, open
+ * source license.
+ *
+ * About this module:
+ *
+ * Content-defined chunking splits a string into chunks at places chosen by
+ * the bytes themselves, not by their offsets.  Inserting or deleting bytes
+ * therefore moves only the chunk boundaries near the edit, and the chunks
+ * further along are unchanged, which is what makes deduplicating them work.
+ * Splitting at fixed offsets instead shifts every later chunk.
+ *
+ * This is FastCDC: a "gear" rolling hash of the bytes since the start of the
+ * chunk, skipping the first minsize of them, declares a boundary wherever the
+ * hash's top bits are all zero.  It checks more bits before avgsize and fewer
+ * bits after it, which pulls chunk sizes towards avgsize, and it always cuts
+ * at maxsize.  Where one chunk ends depends only on the bytes from where it
+ * starts, so every chunking of the same data -- serial, streaming or
+ * parallel -- finds the same boundaries.
+ */
+#ifndef _INCL_zchunk_h
+#define _INCL_zchunk_h
+
+#include "zstr.h"
+
+typedef struct {
+	size_t minsize; /* no chunk is shorter than this, except the last one */
+	size_t avgsize; /* the size to aim for; must be a power of 2 */
+	size_t maxsize; /* no chunk is longer than this */
+} zchunk_params;
+
+/**
+ * The callback which receives each chunk, in order.
+ *
+ * @param ctx the ctx that was passed in
+ * @param chunk the chunk.  For zchunk_all() and zchunk_all_parallel() it
+ *     points into the data that was passed in; for zchunk_stream() it is
+ *     valid only until the callback returns.
+ */
+typedef void (*zchunk_fn)(void* ctx, czstr chunk);
+
+/**
+ * Fill in params with the defaults: minsize 2 KiB, avgsize 8 KiB, maxsize
+ * 64 KiB.
+ *
+ * @precondition params must not be NULL.
+ */
+void
+zchunk_default_params(zchunk_params* params);
+
+/**
+ * @return the length of the first chunk of data, which is taken to start at
+ *     a chunk boundary.  If data is shorter than params->maxsize it is taken
+ *     to end the input too.
+ *
+ * @precondition params->minsize < params->avgsize < params->maxsize
+ */
+size_t
+zchunk_cut(const zchunk_params* params, czstr data);
+
+/**
+ * Split all of data into chunks, calling fn for each.
+ *
+ * @return the number of chunks
+ */
+size_t
+zchunk_all(const zchunk_params* params, czstr data, zchunk_fn fn, void* ctx);
+
+/**
+ * Like zchunk_all(), but with the work split among nthreads threads.  fn is
+ * still called in order on the calling thread, with exactly the chunks that
+ * zchunk_all() would give.
+ *
+ * Each thread chunks its share of data, starting from an arbitrary offset,
+ * and carries on a little way into the next share.  Then the calling thread
+ * follows the true chunk boundaries from the start: once one of them is also
+ * a boundary that the next share's thread found, everything that thread found
+ * after it must be right too.
+ *
+ * @return the number of chunks
+ */
+size_t
+zchunk_all_parallel(const zchunk_params* params, czstr data, size_t nthreads, zchunk_fn fn, void* ctx);
+
+/**
+ * Read fp until EOF, calling fn for each chunk.  This buffers at most a few
+ * times params->maxsize bytes.  It does not fclose() fp.
+ *
+ * @return the number of chunks
+ *
+ * @precondition fp must not be NULL.
+ */
+size_t
+zchunk_stream(const zchunk_params* params, FILE* fp, zchunk_fn fn, void* ctx);
+
+#endif /* #ifndef _INCL_zchunk_h */
+
+
+/**
+ * Copyright (c) 2002-2004 Bryce "Zooko" Wilcox-O'Hearn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software to deal in this software without restriction, including
+ * without limitation the rights to use, modify, distribute, sublicense, and/or
+ * sell copies of this software, and to permit persons to whom this software is
+ * furnished to do so, provided that the above copyright notice and this
+ * permission notice is included in all copies or substantial portions of this
+ * software. THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED.
+ */
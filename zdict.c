@@ -0,0 +1,450 @@
+/**
+ * copyright 2002-2004 Bryce "Zooko" Wilcox-O'Hearn
+ * mailto:zooko@zooko.com
+ *
+ * See the end of this file for the simple, permissive free software, open
+ * source license.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "moreassert.h"
+
+#include "zdict.h"
+#include "zinternal.h"
+
+static const size_t DEFAULT_BLOCKENTRIES = 16;
+static const size_t FOOTERLEN = 28;
+static const char MAGIC[4] = { 'z', 'd', 'c', '1' };
+
+   /** building */
+
+struct zdict_builder {
+	FILE* fp;
+	size_t blockentries;
+	size_t inblock; /* entries so far in the current block */
+	unsigned long long off; /* bytes written so far */
+	unsigned long long nentries;
+	unsigned long long* blockoffs;
+	size_t nblocks;
+	size_t blockcap;
+	zbyte* prev; /* the previous key */
+	size_t prevlen;
+	size_t prevcap;
+	size_t maxkey;
+};
+
+zdict_builder*
+new_zdict_builder(FILE*const fp, const size_t blockentries)
+{
+	zdict_builder* b;
+	assert (fp != NULL); /* @precondition */
+
+	b = (zdict_builder*)malloc(sizeof(zdict_builder));
+#ifdef Z_EXHAUST_EXIT
+	CHECKMALLOCEXIT(b);
+#else
+	if (b == NULL) {
+		return NULL;
+	}
+#endif
+	b->prevcap = 64;
+	b->prev = (zbyte*)malloc(b->prevcap);
+#ifdef Z_EXHAUST_EXIT
+	CHECKMALLOCEXIT(b->prev);
+#else
+	if (b->prev == NULL) {
+		free(b);
+		return NULL;
+	}
+#endif
+	b->fp = fp;
+	b->blockentries = blockentries ? blockentries : DEFAULT_BLOCKENTRIES;
+	b->inblock = 0;
+	b->off = 0;
+	b->nentries = 0;
+	b->blockoffs = NULL;
+	b->nblocks = 0;
+	b->blockcap = 0;
+	b->prevlen = 0;
+	b->maxkey = 0;
+	return b;
+}
+
+static void
+put(zdict_builder*const b, const zbyte*const p, const size_t len)
+{
+	size_t res;
+	if (len == 0)
+		return;
+	res = fwrite(p, sizeof(zbyte), len, b->fp);
+	runtime_assert(res == len, "fwrite() failed to completely write the data.");
+	b->off += len;
+}
+
+static void
+put_varint(zdict_builder*const b, size_t v)
+{
+	zbyte buf[10];
+	size_t n = 0;
+	while (v >= 0x80) {
+		buf[n++] = (zbyte)(v | 0x80);
+		v >>= 7;
+	}
+	buf[n++] = (zbyte)v;
+	put(b, buf, n);
+}
+
+void
+zdb_add(zdict_builder*const b, const czstr key, const czstr value)
+{
+	size_t shared = 0;
+	assert (b != NULL); /* @precondition */
+	runtime_assert((b->nentries == 0) || (zcmp(key, (czstr){ b->prevlen, b->prev }) > 0), "zdict keys must be added in strictly increasing zcmp() order.");
+
+	if ((b->nblocks == 0) || (b->inblock == b->blockentries)) {
+		if (b->nblocks == b->blockcap) {
+			b->blockcap = b->blockcap ? 2 * b->blockcap : 1024;
+			b->blockoffs = (unsigned long long*)realloc(b->blockoffs, b->blockcap * sizeof(unsigned long long));
+			CHECKMALLOCEXIT(b->blockoffs);
+		}
+		b->blockoffs[b->nblocks++] = b->off;
+		b->inblock = 0;
+	} else {
+		while ((shared < key.len) && (shared < b->prevlen) && (key.buf[shared] == b->prev[shared]))
+			shared++;
+	}
+
+	put_varint(b, shared);
+	put_varint(b, key.len - shared);
+	put_varint(b, value.len);
+	put(b, key.buf + shared, key.len - shared);
+	put(b, value.buf, value.len);
+
+	if (key.len > b->prevcap) {
+		b->prevcap = 2 * key.len;
+		b->prev = (zbyte*)realloc(b->prev, b->prevcap);
+		CHECKMALLOCEXIT(b->prev);
+	}
+	memcpy(b->prev + shared, key.buf + shared, key.len - shared);
+	b->prevlen = key.len;
+	if (key.len > b->maxkey)
+		b->maxkey = key.len;
+	b->inblock++;
+	b->nentries++;
+}
+
+void
+zdb_finish(zdict_builder*const b)
+{
+	zbyte footer[28];
+	zbyte off[8];
+	size_t i;
+	assert (b != NULL); /* @precondition */
+	runtime_assert((b->nblocks <= 0xffffffffUL) && (b->maxkey <= 0xffffffffUL), "zdict is too big.");
+
+	z_uint64_encode(b->off, footer);
+	for (i = 0; i < b->nblocks; i++) {
+		z_uint64_encode(b->blockoffs[i], off);
+		put(b, off, 8);
+	}
+	z_uint64_encode(b->nentries, footer + 8);
+	uint32_encode((unsigned)b->nblocks, footer + 16);
+	uint32_encode((unsigned)b->maxkey, footer + 20);
+	memcpy(footer + 24, MAGIC, 4);
+	put(b, footer, FOOTERLEN);
+
+	free(b->blockoffs);
+	free(b->prev);
+	free(b);
+}
+
+   /** reading */
+
+struct zdict {
+	const zbyte* map;
+	size_t maplen;
+	const zbyte* index;
+	size_t nentries;
+	size_t nblocks;
+	size_t maxkey;
+};
+
+zdict*
+zdict_open(const char*const path)
+{
+	struct stat st;
+	const zbyte* footer;
+	unsigned long long indexoff;
+	void* map;
+	zdict* d;
+	int fd;
+	assert (path != NULL); /* @precondition */
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	if ((fstat(fd, &st) != 0) || (st.st_size < (off_t)FOOTERLEN)) {
+		close(fd);
+		return NULL;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+
+	d = (zdict*)malloc(sizeof(zdict));
+#ifdef Z_EXHAUST_EXIT
+	CHECKMALLOCEXIT(d);
+#else
+	if (d == NULL) {
+		munmap(map, st.st_size);
+		return NULL;
+	}
+#endif
+	d->map = (const zbyte*)map;
+	d->maplen = st.st_size;
+
+	footer = d->map + d->maplen - FOOTERLEN;
+	runtime_assert(!memcmp(footer + 24, MAGIC, 4), "Not a zdict file.");
+	indexoff = z_uint64_decode(footer);
+	d->nentries = (size_t)z_uint64_decode(footer + 8);
+	d->nblocks = uint32_decode(footer + 16);
+	d->maxkey = uint32_decode(footer + 20);
+	runtime_assert(indexoff + 8 * (unsigned long long)d->nblocks + FOOTERLEN == d->maplen, "Corrupt zdict file.");
+	d->index = d->map + indexoff;
+	return d;
+}
+
+void
+zdict_close(zdict*const d)
+{
+	if (d == NULL)
+		return;
+	munmap((void*)d->map, d->maplen);
+	free(d);
+}
+
+size_t
+zdict_size(const zdict*const d)
+{
+	assert (d != NULL); /* @precondition */
+	return d->nentries;
+}
+
+static void
+block_bounds(const zdict*const d, const size_t i, const zbyte**const start, const zbyte**const end)
+{
+	unsigned long long s, e;
+	s = z_uint64_decode(d->index + 8 * i);
+	e = (i + 1 < d->nblocks) ? z_uint64_decode(d->index + 8 * (i + 1)) : (unsigned long long)(d->index - d->map);
+	runtime_assert((s < e) && (e <= (unsigned long long)(d->index - d->map)), "Corrupt zdict file.");
+	*start = d->map + s;
+	*end = d->map + e;
+}
+
+static size_t
+get_varint(const zbyte**const pp, const zbyte*const end)
+{
+	const zbyte* p = *pp;
+	size_t v = 0;
+	unsigned shift = 0;
+	for (;;) {
+		runtime_assert((p < end) && (shift < 8 * sizeof(size_t)), "Corrupt zdict file.");
+		v |= (size_t)(*p & 0x7f) << shift;
+		if (!(*p++ & 0x80))
+			break;
+		shift += 7;
+	}
+	*pp = p;
+	return v;
+}
+
+/**
+ * Walks the entries of one or more consecutive blocks, rebuilding each
+ * front-coded key into key.
+ */
+typedef struct {
+	const zdict* d;
+	size_t block; /* the block that p is in */
+	const zbyte* p;
+	const zbyte* end;
+	zbyte* key; /* a buffer of d->maxkey bytes */
+	size_t keylen;
+	czstr value;
+} cursor;
+
+static void
+cursor_init(cursor*const c, const zdict*const d, const size_t block, zbyte*const keybuf)
+{
+	c->d = d;
+	c->block = block;
+	block_bounds(d, block, &c->p, &c->end);
+	c->key = keybuf;
+	c->keylen = 0;
+}
+
+/**
+ * @param crossblocks if 0 then stop at the end of the current block
+ *
+ * @return 1 if there was another entry, which is now in c->key and c->value,
+ *     else 0
+ */
+static int
+cursor_next(cursor*const c, const int crossblocks)
+{
+	size_t shared, suffix, vallen;
+	if (c->p == c->end) {
+		if (!crossblocks || (c->block + 1 == c->d->nblocks))
+			return 0;
+		cursor_init(c, c->d, c->block + 1, c->key);
+	}
+	shared = get_varint(&c->p, c->end);
+	suffix = get_varint(&c->p, c->end);
+	vallen = get_varint(&c->p, c->end);
+	runtime_assert((shared <= c->keylen) && (suffix <= c->d->maxkey - shared), "Corrupt zdict file.");
+	runtime_assert((size_t)(c->end - c->p) >= suffix && (size_t)(c->end - c->p) - suffix >= vallen, "Corrupt zdict file.");
+	memcpy(c->key + shared, c->p, suffix);
+	c->keylen = shared + suffix;
+	c->value = (czstr){ vallen, c->p + suffix };
+	c->p += suffix + vallen;
+	return 1;
+}
+
+/**
+ * @return the first key of block i, which is stored whole, straight from the
+ *     mapped file
+ */
+static czstr
+block_first_key(const zdict*const d, const size_t i)
+{
+	const zbyte* p = d->map + z_uint64_decode(d->index + 8 * i);
+	const zbyte*const end = d->index; /* a looser bound than block_bounds(), but cheaper */
+	size_t shared, suffix;
+	runtime_assert(p < end, "Corrupt zdict file.");
+	shared = get_varint(&p, end);
+	suffix = get_varint(&p, end);
+	get_varint(&p, end);
+	runtime_assert((shared == 0) && ((size_t)(end - p) >= suffix), "Corrupt zdict file.");
+	return (czstr){ suffix, p };
+}
+
+/**
+ * @param strict if 0, find the last block whose first key is <= key; if 1,
+ *     the last block whose first key is < key
+ *
+ * @return that block, or 0 if there is none
+ */
+static size_t
+find_block(const zdict*const d, const czstr key, const int strict)
+{
+	size_t lo = 0, hi = d->nblocks, mid;
+	int cmp;
+	while (hi - lo > 1) {
+		mid = lo + (hi - lo) / 2;
+		cmp = zcmp(block_first_key(d, mid), key);
+		if (strict ? (cmp < 0) : (cmp <= 0))
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/**
+ * Most keys are short, so use a buffer on the stack when we can.
+ */
+#define STACKKEY 256
+
+int
+zdict_get(const zdict*const d, const czstr key, czstr*const value)
+{
+	const zbyte* p;
+	const zbyte* end;
+	size_t shared, suffix, vallen, rest, j;
+	size_t m = 0; /* how many leading bytes the previous key shares with key */
+	assert (d != NULL); /* @precondition */
+
+	if ((d->nblocks == 0) || (key.len > d->maxkey))
+		return 0;
+
+	/* Rather than rebuilding each key, use the fact that the keys are sorted: 
+	 * an entry sharing fewer than m bytes with its predecessor must be 
+	 * greater than key, and one sharing more than m must still be less than 
+	 * key.  Only an entry sharing exactly m bytes needs its suffix compared. */
+	block_bounds(d, find_block(d, key, 0), &p, &end);
+	while (p < end) {
+		shared = get_varint(&p, end);
+		suffix = get_varint(&p, end);
+		vallen = get_varint(&p, end);
+		runtime_assert((size_t)(end - p) >= suffix && (size_t)(end - p) - suffix >= vallen, "Corrupt zdict file.");
+		if (shared < m)
+			return 0;
+		if (shared == m) {
+			rest = key.len - m;
+			for (j = 0; (j < suffix) && (j < rest) && (p[j] == key.buf[m+j]); j++)
+				;
+			if ((j == suffix) && (j == rest)) {
+				if (value != NULL)
+					*value = (czstr){ vallen, p + suffix };
+				return 1;
+			}
+			if ((j == rest) || ((j < suffix) && (p[j] > key.buf[m+j])))
+				return 0; /* this entry, and so every later one, is > key */
+			m += j;
+		}
+		p += suffix + vallen;
+	}
+	return 0;
+}
+
+size_t
+zdict_prefix(const zdict*const d, const czstr prefix, const zdict_fn fn, void*const ctx)
+{
+	zbyte stackbuf[STACKKEY];
+	zbyte* keybuf;
+	cursor c;
+	size_t n = 0;
+	assert (d != NULL); /* @precondition */
+	assert (fn != NULL); /* @precondition */
+
+	if ((d->nblocks == 0) || (prefix.len > d->maxkey))
+		return 0;
+	keybuf = (d->maxkey <= STACKKEY) ? stackbuf : (zbyte*)malloc(d->maxkey);
+	CHECKMALLOCEXIT(keybuf);
+
+	cursor_init(&c, d, find_block(d, prefix, 1), keybuf);
+	while (cursor_next(&c, 1)) {
+		if ((c.keylen >= prefix.len) && !memcmp(c.key, prefix.buf, prefix.len)) {
+			n++;
+			if (fn(ctx, (czstr){ c.keylen, c.key }, c.value))
+				break;
+		} else if (zcmp((czstr){ c.keylen, c.key }, prefix) > 0) {
+			/* Past every key that could start with prefix. */
+			break;
+		}
+	}
+
+	if (keybuf != stackbuf)
+		free(keybuf);
+	return n;
+}
+
+/**
+ * Copyright (c) 2002-2004 Bryce "Zooko" Wilcox-O'Hearn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software to deal in this software without restriction, including
+ * without limitation the rights to use, modify, distribute, sublicense, and/or
+ * sell copies of this software, and to permit persons to whom this software is
+ * furnished to do so, provided that the above copyright notice and this
+ * permission notice is included in all copies or substantial portions of this
+ * software. THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED.
+ */
@@ -0,0 +1,131 @@
+/**
+ * copyright 2002-2004 Bryce "Zooko" Wilcox-O'Hearn
+ * mailto:zooko@zooko.com
+ *
+ * See the end of this file for the simple, permissive free software, open
+ * source license.
+ *
+ * About this module:
+ *
+ * A zdict is an immutable key->value table stored in a file, with the keys
+ * sorted by zcmp().  A zdict_builder writes the file, and zdict_open() mmap()s
+ * it, so opening a table takes the same time no matter how big the table is.
+ * Only the pages that lookups actually touch are ever read from disk.
+ *
+ * The file is a sequence of blocks of up to blockentries entries each,
+ * followed by an index of the offsets of the blocks, followed by a fixed-size
+ * footer.  Keys are front-coded: each entry stores only how many leading
+ * bytes it shares with the previous key, and the rest of the key.  The first
+ * key of each block is stored whole, so a lookup binary-searches the blocks by
+ * their first keys, then scans a single block.
+ *
+ * Each entry is: the shared length, the suffix length and the value length as
+ * LEB128 varints, then the suffix bytes, then the value bytes.  Each index
+ * entry and the footer's fields are big-endian.  The footer is: the offset of
+ * the index (8 bytes), the number of entries (8), the number of blocks (4),
+ * the length of the longest key (4), and the magic number "zdc1".
+ */
+#ifndef _INCL_zdict_h
+#define _INCL_zdict_h
+
+#include "zstr.h"
+
+typedef struct zdict_builder zdict_builder; /* opaque */
+typedef struct zdict zdict; /* opaque */
+
+/**
+ * Allocates a builder that writes a zdict to fp.
+ *
+ * @param blockentries the number of entries per block, or 0 for the default
+ *     of 16.  Bigger blocks make the file smaller and scans longer.
+ *
+ * On  malloc failure (if not Z_EXHAUST_EXIT) then it will return NULL.
+ *
+ * @precondition fp must not be NULL.
+ */
+zdict_builder*
+new_zdict_builder(FILE* fp, size_t blockentries);
+
+/**
+ * Append an entry.  Keys must be added in strictly increasing zcmp() order;
+ * if not, it raises an error with runtime_assert().
+ */
+void
+zdb_add(zdict_builder* b, czstr key, czstr value);
+
+/**
+ * Write the index and footer and free b.  This does not fclose() the stream.
+ *
+ * @precondition b must not be NULL.
+ */
+void
+zdb_finish(zdict_builder* b);
+
+/**
+ * Open and mmap() the zdict file at path.
+ *
+ * @return the zdict, or NULL if the file can't be opened or mapped.  (If it
+ *     can be opened but isn't a zdict, then it raises an error with
+ *     runtime_assert().)
+ *
+ * @precondition path must not be NULL.
+ */
+zdict*
+zdict_open(const char* path);
+
+/**
+ * Unmap and free d.  Any czstrs obtained from d become invalid.
+ */
+void
+zdict_close(zdict* d);
+
+/**
+ * @return the number of entries in d.
+ */
+size_t
+zdict_size(const zdict* d);
+
+/**
+ * Look up key.
+ *
+ * @param value if key is found then *value is set to point at its value,
+ *     inside the mapped file.  It stays valid until zdict_close(), and it is
+ *     not followed by a null-terminating character.  value may be NULL.
+ *
+ * @return 1 if key is found, else 0
+ */
+int
+zdict_get(const zdict* d, czstr key, czstr* value);
+
+/**
+ * The callback for zdict_prefix().  key is valid only until the callback
+ * returns; value is valid until zdict_close().
+ *
+ * @return 0 to keep going, or non-zero to stop
+ */
+typedef int (*zdict_fn)(void* ctx, czstr key, czstr value);
+
+/**
+ * Call fn for every entry whose key begins with prefix, in key order.  (With
+ * the empty prefix that means every entry.)
+ *
+ * @return the number of times fn was called
+ */
+size_t
+zdict_prefix(const zdict* d, czstr prefix, zdict_fn fn, void* ctx);
+
+#endif /* #ifndef _INCL_zdict_h */
+
+
+/**
+ * Copyright (c) 2002-2004 Bryce "Zooko" Wilcox-O'Hearn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software to deal in this software without restriction, including
+ * without limitation the rights to use, modify, distribute, sublicense, and/or
+ * sell copies of this software, and to permit persons to whom this software is
+ * furnished to do so, provided that the above copyright notice and this
+ * permission notice is included in all copies or substantial portions of this
+ * software. THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED.
+ */
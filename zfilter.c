@@ -0,0 +1,764 @@
+/**
+ * copyright 2002-2004 Bryce "Zooko" Wilcox-O'Hearn
+ * mailto:zooko@zooko.com
+ *
+ * See the end of this file for the simple, permissive free software, open
+ * source license.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "moreassert.h"
+
+#include "zfilter.h"
+#include "zinternal.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+#define PREFETCH(p) __builtin_prefetch(p)
+#else
+#define PREFETCH(p) ((void)(p))
+#endif
+
+/* The serialized forms are a HEADERLEN-byte header and then the filter's
+ * bytes, so that in a mmap() the filter starts on a cache line. */
+static const size_t HEADERLEN = 64;
+static const char BLOOM_MAGIC[4] = { 'z', 'b', 'l', '2' };
+static const char XOR_MAGIC[4] = { 'z', 'x', 'o', '1' };
+
+/* Batch queries hash this many keys before testing any of them. */
+#define BATCH 64
+
+   /** hashing */
+
+static uint64_t
+load64le(const zbyte*const p)
+{
+	return (uint64_t)p[0] | ((uint64_t)p[1] << 8) | ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24)
+		| ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) | ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+}
+
+uint64_t
+zhash64(const czstr cz, const uint64_t seed)
+{
+	const uint64_t m = 0xc6a4a7935bd1e995ULL;
+	const zbyte* p = cz.buf;
+	const zbyte*const end = cz.buf + (cz.len & ~(size_t)7);
+	uint64_t h = seed ^ ((uint64_t)cz.len * m);
+	uint64_t k;
+
+	for (; p != end; p += 8) {
+		k = load64le(p);
+		k *= m;
+		k ^= k >> 47;
+		k *= m;
+		h ^= k;
+		h *= m;
+	}
+	switch (cz.len & 7) {
+	case 7: h ^= (uint64_t)p[6] << 48; /* FALLTHROUGH */
+	case 6: h ^= (uint64_t)p[5] << 40; /* FALLTHROUGH */
+	case 5: h ^= (uint64_t)p[4] << 32; /* FALLTHROUGH */
+	case 4: h ^= (uint64_t)p[3] << 24; /* FALLTHROUGH */
+	case 3: h ^= (uint64_t)p[2] << 16; /* FALLTHROUGH */
+	case 2: h ^= (uint64_t)p[1] << 8; /* FALLTHROUGH */
+	case 1: h ^= (uint64_t)p[0];
+		h *= m;
+	}
+	h ^= h >> 47;
+	h *= m;
+	h ^= h >> 47;
+	return h;
+}
+
+/**
+ * The splitmix64 finalizer, for deriving more well-mixed bits from a hash.
+ */
+static uint64_t
+mix64(uint64_t x)
+{
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+/**
+ * Map x uniformly onto [0, n) without a division.
+ */
+static size_t
+reduce(const uint32_t x, const size_t n)
+{
+	return (size_t)(((uint64_t)x * n) >> 32);
+}
+
+   /** parallel hashing */
+
+typedef struct {
+	const czstr* keys;
+	uint64_t* hashes;
+	size_t lo, hi;
+} hashshare;
+
+static void*
+hash_share(void*const arg)
+{
+	hashshare*const s = (hashshare*)arg;
+	size_t i;
+	for (i = s->lo; i < s->hi; i++)
+		s->hashes[i] = zhash64(s->keys[i], 0);
+	return NULL;
+}
+
+/**
+ * @return a new array of the hashes of the n keys, or NULL on malloc
+ *     failure (if not Z_EXHAUST_EXIT)
+ */
+static uint64_t*
+hash_keys(const czstr*const keys, const size_t n, size_t nthreads)
+{
+	uint64_t* hashes;
+	hashshare* shares;
+	size_t k;
+
+	hashes = (uint64_t*)malloc((n ? n : 1) * sizeof(uint64_t));
+#ifdef Z_EXHAUST_EXIT
+	CHECKMALLOCEXIT(hashes);
+#else
+	if (hashes == NULL)
+		return NULL;
+#endif
+	/* Below some thousands of keys per thread there is nothing to gain. */
+	if (nthreads > n / 4096)
+		nthreads = n / 4096;
+	if (nthreads < 1)
+		nthreads = 1;
+	shares = (hashshare*)malloc(nthreads * sizeof(hashshare));
+	CHECKMALLOCEXIT(shares);
+	for (k = 0; k < nthreads; k++)
+		shares[k] = (hashshare){ keys, hashes, n / nthreads * k, (k + 1 == nthreads) ? n : n / nthreads * (k + 1) };
+	z_run_shares(hash_share, shares, sizeof(hashshare), nthreads);
+	free(shares);
+	return hashes;
+}
+
+/**
+ * mmap() the whole of path.
+ *
+ * @return the mapping, or NULL
+ */
+static const zbyte*
+map_file(const char*const path, size_t*const len)
+{
+	struct stat st;
+	void* map;
+	int fd;
+	assert (path != NULL); /* @precondition */
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	if ((fstat(fd, &st) != 0) || (st.st_size < (off_t)HEADERLEN)) {
+		close(fd);
+		return NULL;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+	*len = st.st_size;
+	return (const zbyte*)map;
+}
+
+static void
+write_all(FILE*const fp, const zbyte*const p, const size_t len)
+{
+	size_t res;
+	assert (fp != NULL); /* @precondition */
+	res = fwrite(p, sizeof(zbyte), len, fp);
+	runtime_assert(res == len, "fwrite() failed to completely write the data.");
+}
+
+   /** blocked Bloom filter */
+
+/* Bit j of a block is bit (j % 8) of its byte (j / 8). */
+#define BLOCKBYTES 64
+#define BLOCKBITS (8 * BLOCKBYTES)
+
+struct zbloom {
+	const zbyte* blocks;
+	size_t nblocks;
+	unsigned k; /* bits set per key */
+	zbyte* owned; /* blocks, if we malloc()ed them */
+	const zbyte* map; /* the mmap(), if zbloom_open()ed */
+	size_t maplen;
+};
+
+static size_t
+bloom_block(const zbloom*const f, const uint64_t h)
+{
+	return reduce((uint32_t)(h >> 32), f->nblocks);
+}
+
+/**
+ * Set in mask the k bits for h.  Each bit comes from its own 9-bit field of 
+ * a remix of h, seven to a 64-bit word, so the bits are as independent as 
+ * the hash is.  (Double hashing with a stride from h gave every key with a 
+ * small stride -- the empty key among them, since zhash64() of it is 0 -- 
+ * the same bit over and over.)  The constant keeps h = 0 from remixing to 0.
+ */
+static void
+bloom_mask(const unsigned k, const uint64_t h, zbyte mask[BLOCKBYTES])
+{
+	uint64_t g = mix64(h + 0x9e3779b97f4a7c15ULL);
+	uint32_t j;
+	unsigned i;
+
+	memset(mask, 0, BLOCKBYTES);
+	for (i = 0; i < k; i++) {
+		if ((i % 7 == 0) && (i > 0))
+			g = mix64(g);
+		j = (uint32_t)(g >> (9 * (i % 7))) & (BLOCKBITS - 1);
+		mask[j >> 3] |= (zbyte)(1 << (j & 7));
+	}
+}
+
+/**
+ * @return 1 if all of the bits of mask are set in blk
+ */
+static int
+bloom_test(const zbyte*const blk, const zbyte mask[BLOCKBYTES])
+{
+	/* A fixed-length reduction with no early exit, which the compiler turns
+	 * into a couple of vector and-nots and a test. */
+	zbyte missing = 0;
+	size_t i;
+	for (i = 0; i < BLOCKBYTES; i++)
+		missing |= mask[i] & ~blk[i];
+	return missing == 0;
+}
+
+typedef struct {
+	zbloom* f;
+	const uint64_t* hashes;
+	size_t n;
+	size_t lo, hi; /* the blocks this thread owns */
+} bloomshare;
+
+static void*
+bloom_share(void*const arg)
+{
+	bloomshare*const s = (bloomshare*)arg;
+	zbyte mask[BLOCKBYTES];
+	zbyte* blk;
+	size_t i, b, j;
+
+	for (i = 0; i < s->n; i++) {
+		b = bloom_block(s->f, s->hashes[i]);
+		if ((b < s->lo) || (b >= s->hi))
+			continue;
+		bloom_mask(s->f->k, s->hashes[i], mask);
+		blk = s->f->owned + b * BLOCKBYTES;
+		for (j = 0; j < BLOCKBYTES; j++)
+			blk[j] |= mask[j];
+	}
+	return NULL;
+}
+
+zbloom*
+zbloom_build(const czstr*const keys, const size_t n, const double bits_per_key, size_t nthreads)
+{
+	zbloom* f;
+	uint64_t* hashes;
+	bloomshare* shares;
+	double nbits;
+	size_t k;
+	assert (bits_per_key > 0); /* @precondition */
+
+	f = (zbloom*)malloc(sizeof(zbloom));
+#ifdef Z_EXHAUST_EXIT
+	CHECKMALLOCEXIT(f);
+#else
+	if (f == NULL)
+		return NULL;
+#endif
+	nbits = (double)n * bits_per_key;
+	f->nblocks = (size_t)(nbits / BLOCKBITS) + 1;
+	runtime_assert((uint64_t)f->nblocks <= 0xffffffffULL, "Too many keys for a zbloom.");
+	/* ln(2) bits per key is optimal for a plain Bloom filter. */
+	f->k = (unsigned)(bits_per_key * 0.693 + 0.5);
+	if (f->k < 1)
+		f->k = 1;
+	if (f->k > 16)
+		f->k = 16;
+	f->map = NULL;
+	f->maplen = 0;
+	f->owned = (zbyte*)calloc(f->nblocks, BLOCKBYTES);
+#ifdef Z_EXHAUST_EXIT
+	CHECKMALLOCEXIT(f->owned);
+#else
+	if (f->owned == NULL) {
+		free(f);
+		return NULL;
+	}
+#endif
+	f->blocks = f->owned;
+
+	hashes = hash_keys(keys, n, nthreads);
+	if (hashes == NULL) {
+		zbloom_free(f);
+		return NULL;
+	}
+	/* Every thread reads all the hashes but writes only its own blocks, so
+	 * they need no locking and the result doesn't depend on nthreads. */
+	if (nthreads > n / 4096)
+		nthreads = n / 4096;
+	if (nthreads > f->nblocks)
+		nthreads = f->nblocks;
+	if (nthreads < 1)
+		nthreads = 1;
+	shares = (bloomshare*)malloc(nthreads * sizeof(bloomshare));
+	CHECKMALLOCEXIT(shares);
+	for (k = 0; k < nthreads; k++)
+		shares[k] = (bloomshare){ f, hashes, n, f->nblocks / nthreads * k, (k + 1 == nthreads) ? f->nblocks : f->nblocks / nthreads * (k + 1) };
+	z_run_shares(bloom_share, shares, sizeof(bloomshare), nthreads);
+	free(shares);
+	free(hashes);
+	return f;
+}
+
+int
+zbloom_contains(const zbloom*const f, const czstr key)
+{
+	const uint64_t h = zhash64(key, 0);
+	zbyte mask[BLOCKBYTES];
+	assert (f != NULL); /* @precondition */
+	bloom_mask(f->k, h, mask);
+	return bloom_test(f->blocks + bloom_block(f, h) * BLOCKBYTES, mask);
+}
+
+void
+zbloom_contains_many(const zbloom*const f, const czstr*const keys, const size_t n, zbyte*const results)
+{
+	uint64_t h[BATCH];
+	zbyte mask[BLOCKBYTES];
+	size_t i, j, m;
+	assert (f != NULL); /* @precondition */
+	assert ((n == 0) || ((keys != NULL) && (results != NULL))); /* @precondition */
+
+	for (i = 0; i < n; i += m) {
+		m = (n - i < BATCH) ? n - i : BATCH;
+		for (j = 0; j < m; j++) {
+			h[j] = zhash64(keys[i + j], 0);
+			PREFETCH(f->blocks + bloom_block(f, h[j]) * BLOCKBYTES);
+		}
+		for (j = 0; j < m; j++) {
+			bloom_mask(f->k, h[j], mask);
+			results[i + j] = (zbyte)bloom_test(f->blocks + bloom_block(f, h[j]) * BLOCKBYTES, mask);
+		}
+	}
+}
+
+void
+zbloom_write(const zbloom*const f, FILE*const fp)
+{
+	zbyte header[HEADERLEN];
+	assert (f != NULL); /* @precondition */
+	assert (fp != NULL); /* @precondition */
+
+	memset(header, 0, sizeof(header));
+	memcpy(header, BLOOM_MAGIC, 4);
+	uint32_encode(f->k, header + 4);
+	z_uint64_encode(f->nblocks, header + 8);
+	write_all(fp, header, HEADERLEN);
+	write_all(fp, f->blocks, f->nblocks * BLOCKBYTES);
+}
+
+zbloom*
+zbloom_view(const czstr mem)
+{
+	unsigned long long nblocks;
+	unsigned k;
+	zbloom* f;
+
+	if ((mem.len < HEADERLEN) || memcmp(mem.buf, BLOOM_MAGIC, 4))
+		return NULL;
+	k = uint32_decode(mem.buf + 4);
+	nblocks = z_uint64_decode(mem.buf + 8);
+	if ((k < 1) || (k > 16) || (nblocks < 1) || (nblocks > 0xffffffffULL) || (mem.len - HEADERLEN != nblocks * BLOCKBYTES))
+		return NULL;
+
+	f = (zbloom*)malloc(sizeof(zbloom));
+#ifdef Z_EXHAUST_EXIT
+	CHECKMALLOCEXIT(f);
+#else
+	if (f == NULL)
+		return NULL;
+#endif
+	f->blocks = mem.buf + HEADERLEN;
+	f->nblocks = (size_t)nblocks;
+	f->k = k;
+	f->owned = NULL;
+	f->map = NULL;
+	f->maplen = 0;
+	return f;
+}
+
+zbloom*
+zbloom_open(const char*const path)
+{
+	size_t len;
+	const zbyte*const map = map_file(path, &len);
+	zbloom* f;
+
+	if (map == NULL)
+		return NULL;
+	f = zbloom_view((czstr){ len, map });
+	if (f == NULL) {
+		munmap((void*)map, len);
+		return NULL;
+	}
+	f->map = map;
+	f->maplen = len;
+	return f;
+}
+
+void
+zbloom_free(zbloom*const f)
+{
+	if (f == NULL)
+		return;
+	if (f->map != NULL)
+		munmap((void*)f->map, f->maplen);
+	free(f->owned);
+	free(f);
+}
+
+   /** xor filter */
+
+/* The table has 3 equal parts and each key has one slot in each; a key is in
+ * the set iff its fingerprint is the xor of its 3 slots. */
+struct zxor {
+	const zbyte* fp;
+	size_t blocklen; /* the length of each of the 3 parts */
+	uint64_t seed;
+	zbyte* owned;
+	const zbyte* map;
+	size_t maplen;
+};
+
+static uint64_t
+rotl64(const uint64_t x, const unsigned r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static zbyte
+xor_fingerprint(const uint64_t h)
+{
+	return (zbyte)(h ^ (h >> 32));
+}
+
+static void
+xor_slots(const size_t blocklen, const uint64_t h, size_t slots[3])
+{
+	slots[0] = reduce((uint32_t)h, blocklen);
+	slots[1] = reduce((uint32_t)rotl64(h, 21), blocklen) + blocklen;
+	slots[2] = reduce((uint32_t)rotl64(h, 42), blocklen) + 2 * blocklen;
+}
+
+static int
+cmp_uint64(const void* a, const void* b)
+{
+	const uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * Sort hashes and drop the duplicates.
+ *
+ * @return the number left
+ */
+static size_t
+dedup(uint64_t*const hashes, const size_t n)
+{
+	size_t i, m;
+	qsort(hashes, n, sizeof(uint64_t), cmp_uint64);
+	for (i = 0, m = 0; i < n; i++)
+		if ((m == 0) || (hashes[i] != hashes[m - 1]))
+			hashes[m++] = hashes[i];
+	return m;
+}
+
+/* The keys using a slot so far: the xor of their hashes, and how many. */
+typedef struct {
+	uint64_t mask;
+	uint32_t count;
+} xorslot;
+
+/**
+ * Try to fill in f->owned for the n hashes, with f->seed.
+ *
+ * The construction "peels" the keys: a slot which only one key uses can be
+ * that key's last slot to be assigned, so push that key onto the stack and
+ * forget about it, which may leave other slots with only one key.  If every
+ * key gets pushed, assign the slots in the reverse order.  Duplicate hashes
+ * never peel.
+ *
+ * @return 1 on success, or 0 if the keys didn't all peel
+ */
+static int
+xor_try(zxor*const f, const uint64_t*const hashes, const size_t n, xorslot*const sl, uint32_t*const queue, uint64_t*const stackh, uint32_t*const stacki)
+{
+	const size_t size = 3 * f->blocklen;
+	size_t slots[3];
+	size_t i, j, s, qhead = 0, qtail = 0, top = 0;
+	uint64_t h;
+
+	memset(sl, 0, size * sizeof(xorslot));
+	for (i = 0; i < n; i++) {
+		h = mix64(hashes[i] + f->seed);
+		xor_slots(f->blocklen, h, slots);
+		for (j = 0; j < 3; j++) {
+			sl[slots[j]].mask ^= h;
+			sl[slots[j]].count++;
+		}
+	}
+	for (s = 0; s < size; s++)
+		if (sl[s].count == 1)
+			queue[qtail++] = (uint32_t)s;
+	while (qhead < qtail) {
+		s = queue[qhead++];
+		if (sl[s].count != 1)
+			continue; /* emptied since it was queued */
+		h = sl[s].mask;
+		stackh[top] = h;
+		stacki[top] = (uint32_t)s;
+		top++;
+		xor_slots(f->blocklen, h, slots);
+		for (j = 0; j < 3; j++) {
+			sl[slots[j]].mask ^= h;
+			if (--sl[slots[j]].count == 1)
+				queue[qtail++] = (uint32_t)slots[j];
+		}
+	}
+	if (top != n)
+		return 0;
+
+	memset(f->owned, 0, size);
+	while (top > 0) {
+		top--;
+		h = stackh[top];
+		xor_slots(f->blocklen, h, slots);
+		/* f->owned[stacki[top]] is still 0, so this sets it to whatever makes
+		 * the 3 slots xor to the fingerprint. */
+		f->owned[stacki[top]] = xor_fingerprint(h) ^ f->owned[slots[0]] ^ f->owned[slots[1]] ^ f->owned[slots[2]];
+	}
+	return 1;
+}
+
+zxor*
+zxor_build(const czstr*const keys, size_t n, const size_t nthreads)
+{
+	zxor* f;
+	uint64_t* hashes;
+	xorslot* sl;
+	uint32_t* queue;
+	uint64_t* stackh;
+	uint32_t* stacki;
+	size_t size;
+	unsigned attempt;
+	int deduped = 0;
+
+	runtime_assert((uint64_t)n < 0xffffffffULL / 4, "Too many keys for a zxor.");
+	hashes = hash_keys(keys, n, nthreads);
+	if (hashes == NULL)
+		return NULL;
+
+	f = (zxor*)malloc(sizeof(zxor));
+#ifdef Z_EXHAUST_EXIT
+	CHECKMALLOCEXIT(f);
+#else
+	if (f == NULL) {
+		free(hashes);
+		return NULL;
+	}
+#endif
+	/* 1.23 slots per key is just above the threshold where peeling almost
+	 * always succeeds, for large n; small n needs the extra 32. */
+	f->blocklen = (32 + (size_t)(1.23 * (double)n) + 2) / 3;
+	size = 3 * f->blocklen;
+	f->map = NULL;
+	f->maplen = 0;
+	f->owned = (zbyte*)malloc(size);
+	sl = (xorslot*)malloc(size * sizeof(xorslot));
+	/* Every slot is queued at most once at the start, and once more each time
+	 * a peeled key leaves it with one key. */
+	queue = (uint32_t*)malloc((size + 3 * n) * sizeof(uint32_t));
+	stackh = (uint64_t*)malloc((n ? n : 1) * sizeof(uint64_t));
+	stacki = (uint32_t*)malloc((n ? n : 1) * sizeof(uint32_t));
+#ifdef Z_EXHAUST_EXIT
+	CHECKMALLOCEXIT(f->owned);
+	CHECKMALLOCEXIT(sl);
+	CHECKMALLOCEXIT(queue);
+	CHECKMALLOCEXIT(stackh);
+	CHECKMALLOCEXIT(stacki);
+#else
+	if ((f->owned == NULL) || (sl == NULL) || (queue == NULL) || (stackh == NULL) || (stacki == NULL)) {
+		free(f->owned);
+		free(f);
+		f = NULL;
+		goto done;
+	}
+#endif
+	f->fp = f->owned;
+
+	for (attempt = 0; ; attempt++) {
+		runtime_assert(attempt < 100, "zxor construction failed.");
+		f->seed = mix64(0x7a786f72ULL + attempt);
+		if (xor_try(f, hashes, n, sl, queue, stackh, stacki))
+			break;
+		/* Sorting is most of the cost of a build, so only look for
+		 * duplicates (and the rare distinct keys with the same 64-bit hash,
+		 * which a filter can't tell apart anyway) once a try has failed. */
+		if (!deduped) {
+			n = dedup(hashes, n);
+			deduped = 1;
+		}
+	}
+
+#ifndef Z_EXHAUST_EXIT
+done:
+#endif
+	free(hashes);
+	free(sl);
+	free(queue);
+	free(stackh);
+	free(stacki);
+	return f;
+}
+
+int
+zxor_contains(const zxor*const f, const czstr key)
+{
+	uint64_t h;
+	size_t slots[3];
+	assert (f != NULL); /* @precondition */
+	h = mix64(zhash64(key, 0) + f->seed);
+	xor_slots(f->blocklen, h, slots);
+	return xor_fingerprint(h) == (f->fp[slots[0]] ^ f->fp[slots[1]] ^ f->fp[slots[2]]);
+}
+
+void
+zxor_contains_many(const zxor*const f, const czstr*const keys, const size_t n, zbyte*const results)
+{
+	uint64_t h[BATCH];
+	size_t slots[BATCH][3];
+	size_t i, j, m;
+	assert (f != NULL); /* @precondition */
+	assert ((n == 0) || ((keys != NULL) && (results != NULL))); /* @precondition */
+
+	for (i = 0; i < n; i += m) {
+		m = (n - i < BATCH) ? n - i : BATCH;
+		for (j = 0; j < m; j++) {
+			h[j] = mix64(zhash64(keys[i + j], 0) + f->seed);
+			xor_slots(f->blocklen, h[j], slots[j]);
+			PREFETCH(f->fp + slots[j][0]);
+			PREFETCH(f->fp + slots[j][1]);
+			PREFETCH(f->fp + slots[j][2]);
+		}
+		for (j = 0; j < m; j++)
+			results[i + j] = (zbyte)(xor_fingerprint(h[j]) == (f->fp[slots[j][0]] ^ f->fp[slots[j][1]] ^ f->fp[slots[j][2]]));
+	}
+}
+
+void
+zxor_write(const zxor*const f, FILE*const fp)
+{
+	zbyte header[HEADERLEN];
+	assert (f != NULL); /* @precondition */
+	assert (fp != NULL); /* @precondition */
+
+	memset(header, 0, sizeof(header));
+	memcpy(header, XOR_MAGIC, 4);
+	z_uint64_encode(f->seed, header + 8);
+	z_uint64_encode(f->blocklen, header + 16);
+	write_all(fp, header, HEADERLEN);
+	write_all(fp, f->fp, 3 * f->blocklen);
+}
+
+zxor*
+zxor_view(const czstr mem)
+{
+	unsigned long long blocklen;
+	zxor* f;
+
+	if ((mem.len < HEADERLEN) || memcmp(mem.buf, XOR_MAGIC, 4))
+		return NULL;
+	blocklen = z_uint64_decode(mem.buf + 16);
+	if ((blocklen < 1) || (blocklen > 0xffffffffULL) || (mem.len - HEADERLEN != 3 * blocklen))
+		return NULL;
+
+	f = (zxor*)malloc(sizeof(zxor));
+#ifdef Z_EXHAUST_EXIT
+	CHECKMALLOCEXIT(f);
+#else
+	if (f == NULL)
+		return NULL;
+#endif
+	f->fp = mem.buf + HEADERLEN;
+	f->blocklen = (size_t)blocklen;
+	f->seed = z_uint64_decode(mem.buf + 8);
+	f->owned = NULL;
+	f->map = NULL;
+	f->maplen = 0;
+	return f;
+}
+
+zxor*
+zxor_open(const char*const path)
+{
+	size_t len;
+	const zbyte*const map = map_file(path, &len);
+	zxor* f;
+
+	if (map == NULL)
+		return NULL;
+	f = zxor_view((czstr){ len, map });
+	if (f == NULL) {
+		munmap((void*)map, len);
+		return NULL;
+	}
+	f->map = map;
+	f->maplen = len;
+	return f;
+}
+
+void
+zxor_free(zxor*const f)
+{
+	if (f == NULL)
+		return;
+	if (f->map != NULL)
+		munmap((void*)f->map, f->maplen);
+	free(f->owned);
+	free(f);
+}
+
+
+/**
+ * Copyright (c) 2002-2004 Bryce "Zooko" Wilcox-O'Hearn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software to deal in this software without restriction, including
+ * without limitation the rights to use, modify, distribute, sublicense, and/or
+ * sell copies of this software, and to permit persons to whom this software is
+ * furnished to do so, provided that the above copyright notice and this
+ * permission notice is included in all copies or substantial portions of this
+ * software. THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED.
+ */
@@ -0,0 +1,145 @@
+/**
+ * copyright 2002-2004 Bryce "Zooko" Wilcox-O'Hearn
+ * mailto:zooko@zooko.com
+ *
+ * See the end of this file for the simple, permissive free software, open
+ * source license.
+ *
+ * About this module:
+ *
+ * Approximate-membership filters over sets of czstrs.  A filter answers "is
+ * this key in the set?" with either "no", which is always right, or "maybe",
+ * which is wrong for a small fraction of absent keys (the false-positive
+ * rate).  That makes them good for skipping expensive lookups of keys that
+ * are not there.
+ *
+ * zbloom is a cache-blocked Bloom filter.  All of a key's bits are in one
+ * 64-byte block, so a query touches one cache line.  The false-positive rate
+ * depends on how many bits per key you give it: about 2.4% at 8, 1% at 10,
+ * 0.4% at 12, 0.09% at 16.
+ *
+ * zxor is an xor filter with 8-bit fingerprints (Graf and Lemire, "Xor
+ * Filters: Faster and Smaller Than Bloom and Cuckoo Filters", 2020).  It
+ * always uses about 9.84 bits per key, for a false-positive rate of about
+ * 0.4%, and a query reads exactly three bytes.
+ *
+ * Both can be written to a file with *_write() and then used straight from
+ * memory -- for instance a mmap() of the file -- with *_view(), without
+ * copying or parsing.  *_open() does the mmap() for you.  The serialized form
+ * is the same on every platform.
+ */
+#ifndef _INCL_zfilter_h
+#define _INCL_zfilter_h
+
+#include <stdint.h>
+
+#include "zstr.h"
+
+/**
+ * A fast non-cryptographic 64-bit hash of cz (MurmurHash64A).
+ */
+uint64_t
+zhash64(czstr cz, uint64_t seed);
+
+typedef struct zbloom zbloom; /* opaque */
+typedef struct zxor zxor; /* opaque */
+
+/**
+ * Build a Bloom filter containing the n keys, with about bits_per_key bits
+ * per key.  The keys are hashed on nthreads threads, and then each thread
+ * sets the bits in its own share of the blocks.
+ *
+ * On  malloc failure (if not Z_EXHAUST_EXIT) then it will return NULL.
+ *
+ * @precondition bits_per_key must be > 0.
+ */
+zbloom*
+zbloom_build(const czstr* keys, size_t n, double bits_per_key, size_t nthreads);
+
+/**
+ * @return 1 if key may be in the set, or 0 if it definitely is not.
+ */
+int
+zbloom_contains(const zbloom* f, czstr key);
+
+/**
+ * Query n keys at once, setting results[i] to zbloom_contains(f, keys[i]).
+ * This hashes all of the keys and prefetches their blocks before testing
+ * any of them, so the cache misses overlap instead of happening one at a
+ * time.
+ */
+void
+zbloom_contains_many(const zbloom* f, const czstr* keys, size_t n, zbyte* results);
+
+/**
+ * Write f to fp in its serialized form.
+ *
+ * @precondition fp must not be NULL.
+ */
+void
+zbloom_write(const zbloom* f, FILE* fp);
+
+/**
+ * Use a serialized filter from memory, without copying it.  mem must stay
+ * valid and unchanged until zbloom_free().
+ *
+ * @return the filter, or NULL if mem is not a serialized zbloom.
+ */
+zbloom*
+zbloom_view(czstr mem);
+
+/**
+ * mmap() a file written by zbloom_write().
+ *
+ * @return the filter, or NULL if the file can't be mapped or is not a
+ *     serialized zbloom.
+ */
+zbloom*
+zbloom_open(const char* path);
+
+void
+zbloom_free(zbloom* f);
+
+/**
+ * Build an xor filter containing the n keys.  (Duplicate keys are fine.)
+ * The keys are hashed on nthreads threads; the rest of the construction is
+ * serial.
+ *
+ * On  malloc failure (if not Z_EXHAUST_EXIT) then it will return NULL.
+ */
+zxor*
+zxor_build(const czstr* keys, size_t n, size_t nthreads);
+
+int
+zxor_contains(const zxor* f, czstr key);
+
+void
+zxor_contains_many(const zxor* f, const czstr* keys, size_t n, zbyte* results);
+
+void
+zxor_write(const zxor* f, FILE* fp);
+
+zxor*
+zxor_view(czstr mem);
+
+zxor*
+zxor_open(const char* path);
+
+void
+zxor_free(zxor* f);
+
+#endif /* #ifndef _INCL_zfilter_h */
+
+
+/**
+ * Copyright (c) 2002-2004 Bryce "Zooko" Wilcox-O'Hearn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software to deal in this software without restriction, including
+ * without limitation the rights to use, modify, distribute, sublicense, and/or
+ * sell copies of this software, and to permit persons to whom this software is
+ * furnished to do so, provided that the above copyright notice and this
+ * permission notice is included in all copies or substantial portions of this
+ * software. THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED.
+ */
@@ -0,0 +1,58 @@
+/**
+ * copyright 2002-2004 Bryce "Zooko" Wilcox-O'Hearn
+ * mailto:zooko@zooko.com
+ *
+ * See the end of this file for the simple, permissive free software, open
+ * source license.
+*/
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "moreassert.h"
+
+#include "zinternal.h"
+
+void
+z_uint64_encode(const unsigned long long v, zbyte*const p)
+{
+	uint32_encode((unsigned)(v >> 32), p);
+	uint32_encode((unsigned)(v & 0xffffffffUL), p + 4);
+}
+
+unsigned long long
+z_uint64_decode(const zbyte*const p)
+{
+	return ((unsigned long long)uint32_decode(p) << 32) | uint32_decode(p + 4);
+}
+
+void
+z_run_shares(void* (*const fn)(void*), void*const args, const size_t argsize, const size_t nthreads)
+{
+	pthread_t* threads;
+	size_t k;
+	assert (nthreads >= 1); /* @precondition */
+
+	threads = (pthread_t*)malloc(nthreads * sizeof(pthread_t));
+	CHECKMALLOCEXIT(threads);
+	for (k = 1; k < nthreads; k++)
+		runtime_assert(pthread_create(&threads[k], NULL, fn, (char*)args + k * argsize) == 0, "pthread_create() failed.");
+	fn(args);
+	for (k = 1; k < nthreads; k++)
+		pthread_join(threads[k], NULL);
+	free(threads);
+}
+
+
+/**
+ * Copyright (c) 2002-2004 Bryce "Zooko" Wilcox-O'Hearn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software to deal in this software without restriction, including
+ * without limitation the rights to use, modify, distribute, sublicense, and/or
+ * sell copies of this software, and to permit persons to whom this software is
+ * furnished to do so, provided that the above copyright notice and this
+ * permission notice is included in all copies or substantial portions of this
+ * software. THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED.
+ */
@@ -0,0 +1,52 @@
+/**
+ * copyright 2002-2004 Bryce "Zooko" Wilcox-O'Hearn
+ * mailto:zooko@zooko.com
+ *
+ * See the end of this file for the simple, permissive free software, open
+ * source license.
+ *
+ * About this module:
+ *
+ * Helpers shared by the other libzstr modules.  This is not part of the
+ * public interface.
+ */
+#ifndef _INCL_zinternal_h
+#define _INCL_zinternal_h
+
+#include "zstr.h"
+
+/**
+ * Write v to p as 8 big-endian bytes.
+ */
+void
+z_uint64_encode(unsigned long long v, zbyte* p);
+
+unsigned long long
+z_uint64_decode(const zbyte* p);
+
+/**
+ * Run fn(arg) for each of nthreads args, which are in an array with
+ * elements argsize bytes long.  The first runs on the calling thread and
+ * the rest on threads of their own.  Returns once all of them have
+ * returned.
+ *
+ * @precondition nthreads must be at least 1.
+ */
+void
+z_run_shares(void* (*fn)(void*), void* args, size_t argsize, size_t nthreads);
+
+#endif /* #ifndef _INCL_zinternal_h */
+
+
+/**
+ * Copyright (c) 2002-2004 Bryce "Zooko" Wilcox-O'Hearn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software to deal in this software without restriction, including
+ * without limitation the rights to use, modify, distribute, sublicense, and/or
+ * sell copies of this software, and to permit persons to whom this software is
+ * furnished to do so, provided that the above copyright notice and this
+ * permission notice is included in all copies or substantial portions of this
+ * software. THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED.
+ */
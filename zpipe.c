@@ -0,0 +1,311 @@
+/**
+ * copyright 2002-2004 Bryce "Zooko" Wilcox-O'Hearn
+ * mailto:zooko@zooko.com
+ *
+ * See the end of this file for the simple, permissive free software, open
+ * source license.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "moreassert.h"
+
+#include "zpipe.h"
+
+/**
+ * A batch is some consecutive frames, all from the same block.  It holds a
+ * reference to the block so the frames stay valid until a worker is done
+ * with them.
+ */
+typedef struct {
+	size_t seq; /* the index of this batch in the stream */
+	size_t firstframe; /* the index of frames[0] in the stream */
+	size_t n;
+	szstr block;
+	czstr frames[];
+} batch;
+
+/**
+ * A bounded multi-producer multi-consumer queue of batch pointers, after
+ * Dmitry Vyukov's design: each cell carries a sequence number which tells a
+ * producer or consumer at position pos whether the cell is ready for it, so
+ * pushing and popping each take a single compare-and-swap and no lock.
+ */
+typedef struct {
+	atomic_size_t seq;
+	batch* b;
+} cell;
+
+typedef struct {
+	cell* cells;
+	size_t mask;
+	char pad0[64]; /* keep head and tail on separate cache lines */
+	atomic_size_t head;
+	char pad1[64];
+	atomic_size_t tail;
+	char pad2[64];
+} bqueue;
+
+static void
+bq_init(bqueue*const q, size_t len)
+{
+	size_t i;
+	assert ((len != 0) && ((len & (len-1)) == 0)); /* @precondition */
+	/* With a single cell, a full cell's seq is also what the next lap's
+	 * push takes to mean empty, so the queue needs at least 2. */
+	if (len < 2)
+		len = 2;
+	q->cells = (cell*)malloc(len * sizeof(cell));
+	CHECKMALLOCEXIT(q->cells);
+	for (i = 0; i < len; i++)
+		atomic_init(&q->cells[i].seq, i);
+	q->mask = len - 1;
+	atomic_init(&q->head, 0);
+	atomic_init(&q->tail, 0);
+}
+
+static int
+bq_try_push(bqueue*const q, batch*const b)
+{
+	size_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+	cell* c;
+	intptr_t dif;
+	for (;;) {
+		c = &q->cells[pos & q->mask];
+		dif = (intptr_t)atomic_load_explicit(&c->seq, memory_order_acquire) - (intptr_t)pos;
+		if (dif == 0) {
+			if (atomic_compare_exchange_weak_explicit(&q->head, &pos, pos+1, memory_order_relaxed, memory_order_relaxed))
+				break;
+		} else if (dif < 0) {
+			return 0; /* full */
+		} else {
+			pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+		}
+	}
+	c->b = b;
+	atomic_store_explicit(&c->seq, pos+1, memory_order_release);
+	return 1;
+}
+
+static int
+bq_try_pop(bqueue*const q, batch**const out)
+{
+	size_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	cell* c;
+	intptr_t dif;
+	for (;;) {
+		c = &q->cells[pos & q->mask];
+		dif = (intptr_t)atomic_load_explicit(&c->seq, memory_order_acquire) - (intptr_t)(pos+1);
+		if (dif == 0) {
+			if (atomic_compare_exchange_weak_explicit(&q->tail, &pos, pos+1, memory_order_relaxed, memory_order_relaxed))
+				break;
+		} else if (dif < 0) {
+			return 0; /* empty */
+		} else {
+			pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+		}
+	}
+	*out = c->b;
+	atomic_store_explicit(&c->seq, pos + q->mask + 1, memory_order_release);
+	return 1;
+}
+
+/**
+ * Wait a little while for another thread: yield for the first few tries, then
+ * sleep, so that an idle worker (or a reader held up by backpressure) does
+ * not keep a core busy.
+ */
+static void
+backoff(unsigned*const spins)
+{
+	static const struct timespec nap = { 0, 50000 };
+	if (++*spins < 64)
+		sched_yield();
+	else
+		nanosleep(&nap, NULL);
+}
+
+static void
+bq_push(bqueue*const q, batch*const b)
+{
+	unsigned spins = 0;
+	while (!bq_try_push(q, b))
+		backoff(&spins);
+}
+
+static batch*
+bq_pop(bqueue*const q)
+{
+	unsigned spins = 0;
+	batch* b;
+	while (!bq_try_pop(q, &b))
+		backoff(&spins);
+	return b;
+}
+
+typedef struct {
+	bqueue q;
+	zpipe_frame_fn fn;
+	void* ctx;
+	int ordered;
+	atomic_size_t nextbatch; /* in ordered mode, the batch whose turn it is */
+} pipeline;
+
+static void*
+worker(void*const arg)
+{
+	pipeline*const p = (pipeline*)arg;
+	batch* b;
+	size_t i;
+	unsigned spins;
+
+	/* A NULL batch means the reader is done. */
+	while ((b = bq_pop(&p->q)) != NULL) {
+		if (p->ordered) {
+			/* Every earlier batch has already been popped by some worker, so
+			 * this wait always ends. */
+			spins = 0;
+			while (atomic_load_explicit(&p->nextbatch, memory_order_acquire) != b->seq)
+				backoff(&spins);
+		}
+		for (i = 0; i < b->n; i++)
+			p->fn(p->ctx, b->frames[i], b->firstframe + i);
+		if (p->ordered)
+			atomic_store_explicit(&p->nextbatch, b->seq + 1, memory_order_release);
+		free_sz(b->block);
+		free(b);
+	}
+	return NULL;
+}
+
+static batch*
+new_batch(const szstr block, const size_t seq, const size_t firstframe, const size_t batchsize)
+{
+	batch*const b = (batch*)malloc(sizeof(batch) + batchsize * sizeof(czstr));
+	CHECKMALLOCEXIT(b);
+	b->seq = seq;
+	b->firstframe = firstframe;
+	b->n = 0;
+	b->block = sz_ref(block);
+	return b;
+}
+
+void
+zpipe_default_opts(zpipe_opts*const opts)
+{
+	assert (opts != NULL); /* @precondition */
+	opts->nworkers = 4;
+	opts->blocksize = 1024 * 1024;
+	opts->batchsize = 256;
+	opts->queuelen = 64;
+	opts->ordered = 0;
+}
+
+size_t
+z_decode_pipeline(FILE* fp, const zpipe_opts* opts, const zpipe_frame_fn fn, void*const ctx)
+{
+	zpipe_opts defaults;
+	pipeline p;
+	pthread_t* threads;
+	szstr block = { 0, NULL, NULL };
+	czstr tail = { 0, NULL }; /* the incomplete frame at the end of block */
+	size_t need = 4; /* the size of the frame that tail is the start of */
+	size_t nframes = 0;
+	size_t nbatches = 0;
+	size_t i, cap, res, len;
+	const zbyte* bp;
+	const zbyte* end;
+	batch* b;
+	zstr z;
+	assert (fp != NULL); /* @precondition */
+	assert (fn != NULL); /* @precondition */
+
+	if (opts == NULL) {
+		zpipe_default_opts(&defaults);
+		opts = &defaults;
+	}
+	assert (opts->nworkers >= 1); /* @precondition */
+	assert (opts->blocksize >= 4); /* @precondition */
+	assert (opts->batchsize >= 1); /* @precondition */
+
+	bq_init(&p.q, opts->queuelen);
+	p.fn = fn;
+	p.ctx = ctx;
+	p.ordered = opts->ordered;
+	atomic_init(&p.nextbatch, 0);
+
+	threads = (pthread_t*)malloc(opts->nworkers * sizeof(pthread_t));
+	CHECKMALLOCEXIT(threads);
+	for (i = 0; i < opts->nworkers; i++)
+		runtime_assert(pthread_create(&threads[i], NULL, worker, &p) == 0, "pthread_create() failed.");
+
+	for (;;) {
+		/* Start each block with the leftover partial frame, so that every
+		 * frame lies entirely within one block. */
+		cap = (need > opts->blocksize) ? need : opts->blocksize;
+		z = new_z(cap);
+		if (tail.len != 0)
+			memcpy(z.buf, tail.buf, tail.len);
+		res = fread(z.buf + tail.len, sizeof(zbyte), cap - tail.len, fp);
+		runtime_assert(!ferror(fp), "file error");
+		free_sz(block);
+		if (res == 0) {
+			free_z(z);
+			runtime_assert(tail.len == 0, "The stream ended in the middle of a frame.");
+			break;
+		}
+		z.len = tail.len + res;
+		block = sz_adopt_z(z);
+
+		bp = block.buf;
+		end = block.buf + block.len;
+		b = NULL;
+		while (end - bp >= 4) {
+			len = (size_t)uint32_decode(bp);
+			if ((size_t)(end - bp) - 4 < len)
+				break;
+			if (b == NULL)
+				b = new_batch(block, nbatches++, nframes, opts->batchsize);
+			b->frames[b->n++] = (czstr){ len, bp + 4 };
+			nframes++;
+			bp += 4 + len;
+			if (b->n == opts->batchsize) {
+				bq_push(&p.q, b);
+				b = NULL;
+			}
+		}
+		if (b != NULL)
+			bq_push(&p.q, b);
+
+		tail = (czstr){ end - bp, bp };
+		need = (tail.len >= 4) ? 4 + (size_t)uint32_decode(tail.buf) : 4;
+	}
+
+	for (i = 0; i < opts->nworkers; i++)
+		bq_push(&p.q, NULL);
+	for (i = 0; i < opts->nworkers; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+	free(p.q.cells);
+	return nframes;
+}
+
+/**
+ * Copyright (c) 2002-2004 Bryce "Zooko" Wilcox-O'Hearn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software to deal in this software without restriction, including
+ * without limitation the rights to use, modify, distribute, sublicense, and/or
+ * sell copies of this software, and to permit persons to whom this software is
+ * furnished to do so, provided that the above copyright notice and this
+ * permission notice is included in all copies or substantial portions of this
+ * software. THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED.
+ */
@@ -0,0 +1,96 @@
+/**
+ * copyright 2002-2004 Bryce "Zooko" Wilcox-O'Hearn
+ * mailto:zooko@zooko.com
+ *
+ * See the end of this file for the simple, permissive free software, open
+ * source license.
+ *
+ * About this module:
+ *
+ * z_decode() reads one frame at a time, with two fread()s and a malloc() per
+ * frame, all on the calling thread.  z_decode_pipeline() decodes a whole
+ * stream of z_encode() frames instead, in three stages:
+ *
+ * 1. The calling thread fread()s the stream in large blocks.
+ * 2. The calling thread then finds the frame boundaries in each block and
+ *    groups the frames into batches, each of which is an array of czstrs
+ *    pointing straight into the block, so nothing is copied.  (A frame that
+ *    straddles two blocks is moved to the start of the next block.)
+ * 3. The batches go through a bounded lock-free queue to a pool of worker
+ *    threads, which call your callback once for each frame.  If the workers
+ *    fall behind then the queue fills up and the reader waits for them
+ *    (backpressure), so memory use stays bounded by about
+ *    queuelen * blocksize.
+ */
+#ifndef _INCL_zpipe_h
+#define _INCL_zpipe_h
+
+#include "zstr.h"
+
+/**
+ * The callback which receives each frame.
+ *
+ * @param ctx the ctx that was passed to z_decode_pipeline()
+ * @param frame the frame's contents.  It is valid only until the callback
+ *     returns, and unlike the result of z_decode() it is not followed by a
+ *     null-terminating character.
+ * @param seq the index of the frame in the stream, counting from 0
+ */
+typedef void (*zpipe_frame_fn)(void* ctx, czstr frame, size_t seq);
+
+typedef struct {
+	size_t nworkers; /* number of worker threads; must be at least 1 */
+	size_t blocksize; /* bytes to fread() at a time */
+	size_t batchsize; /* maximum frames handed to a worker at a time */
+	size_t queuelen; /* maximum batches waiting for a worker; must be a power of 2 (1 is taken as 2) */
+	int ordered; /* if non-zero, callbacks run one at a time, in stream order */
+} zpipe_opts;
+
+/**
+ * Fill in opts with reasonable defaults: 4 workers, 1 MiB blocks, 256 frames
+ * per batch, a queue of 64 batches, unordered.
+ *
+ * @precondition opts must not be NULL.
+ */
+void
+zpipe_default_opts(zpipe_opts* opts);
+
+/**
+ * Decode every z_encode() frame from fp until EOF, calling fn(ctx, frame, seq)
+ * for each.  This returns after all of the callbacks have returned.
+ *
+ * If opts->ordered is 0 then callbacks run concurrently on all the workers,
+ * in no particular order, so fn must be thread-safe.  If opts->ordered is
+ * non-zero then fn is called for frame 0, then frame 1, and so on, never
+ * concurrently (though not always from the same thread).  Ordered mode still
+ * overlaps reading and framing with the callbacks, but the callbacks
+ * themselves are serialized.
+ *
+ * If the stream ends in the middle of a frame then it raises an error with
+ * runtime_assert(), as z_decode() does.
+ *
+ * @param opts the options, or NULL for the defaults
+ *
+ * @return the number of frames decoded
+ *
+ * @precondition fp must not be NULL.
+ * @precondition fn must not be NULL.
+ */
+size_t
+z_decode_pipeline(FILE* fp, const zpipe_opts* opts, zpipe_frame_fn fn, void* ctx);
+
+#endif /* #ifndef _INCL_zpipe_h */
+
+
+/**
+ * Copyright (c) 2002-2004 Bryce "Zooko" Wilcox-O'Hearn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software to deal in this software without restriction, including
+ * without limitation the rights to use, modify, distribute, sublicense, and/or
+ * sell copies of this software, and to permit persons to whom this software is
+ * furnished to do so, provided that the above copyright notice and this
+ * permission notice is included in all copies or substantial portions of this
+ * software. THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED.
+ */
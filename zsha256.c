@@ -0,0 +1,433 @@
+/**
+ * copyright 2002-2004 Bryce "Zooko" Wilcox-O'Hearn
+ * mailto:zooko@zooko.com
+ *
+ * See the end of this file for the simple, permissive free software, open
+ * source license.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdatomic.h>
+
+#include "moreassert.h"
+
+#include "zsha256.h"
+#include "zinternal.h"
+
+#if !defined(ZSHA256_PORTABLE) && defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define ZSHA256_SHANI
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+static const uint32_t K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void
+blocks_portable(uint32_t h[8], const zbyte* p, size_t nblocks)
+{
+	uint32_t w[64];
+	uint32_t a, b, c, d, e, f, g, hh, t1, t2;
+	size_t i;
+
+	for (; nblocks > 0; nblocks--, p += 64) {
+		for (i = 0; i < 16; i++)
+			w[i] = ((uint32_t)p[4*i] << 24) | ((uint32_t)p[4*i+1] << 16) | ((uint32_t)p[4*i+2] << 8) | p[4*i+3];
+		for (i = 16; i < 64; i++)
+			w[i] = w[i-16] + (ROR(w[i-15], 7) ^ ROR(w[i-15], 18) ^ (w[i-15] >> 3))
+				+ w[i-7] + (ROR(w[i-2], 17) ^ ROR(w[i-2], 19) ^ (w[i-2] >> 10));
+
+		a = h[0]; b = h[1]; c = h[2]; d = h[3];
+		e = h[4]; f = h[5]; g = h[6]; hh = h[7];
+		for (i = 0; i < 64; i++) {
+			t1 = hh + (ROR(e, 6) ^ ROR(e, 11) ^ ROR(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+			t2 = (ROR(a, 2) ^ ROR(a, 13) ^ ROR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+			hh = g; g = f; f = e; e = d + t1;
+			d = c; c = b; b = a; a = t1 + t2;
+		}
+		h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+		h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+	}
+}
+
+#ifdef ZSHA256_SHANI
+/**
+ * The same as blocks_portable(), with the SHA extensions.  The state is kept
+ * in two registers in the order the instructions want, ABEF and CDGH.
+ */
+__attribute__((target("sha,sse4.1")))
+static void
+blocks_shani(uint32_t h[8], const zbyte* p, size_t nblocks)
+{
+	const __m128i BSWAP = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m128i state0, state1, abef, cdgh, tmp, msg;
+	__m128i w[4];
+	int g;
+
+	tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&h[0]), 0xb1); /* CDAB */
+	state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&h[4]), 0x1b); /* EFGH */
+	state0 = _mm_alignr_epi8(tmp, state1, 8); /* ABEF */
+	state1 = _mm_blend_epi16(state1, tmp, 0xf0); /* CDGH */
+
+	for (; nblocks > 0; nblocks--, p += 64) {
+		abef = state0;
+		cdgh = state1;
+		/* Group g is rounds 4g to 4g+3, and uses message words w[g%4]. */
+#pragma GCC unroll 16
+		for (g = 0; g < 16; g++) {
+			if (g < 4) {
+				w[g] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(p + 16*g)), BSWAP);
+			} else {
+				w[g&3] = _mm_sha256msg1_epu32(w[g&3], w[(g+1)&3]);
+				w[g&3] = _mm_add_epi32(w[g&3], _mm_alignr_epi8(w[(g+3)&3], w[(g+2)&3], 4));
+				w[g&3] = _mm_sha256msg2_epu32(w[g&3], w[(g+3)&3]);
+			}
+			msg = _mm_add_epi32(w[g&3], _mm_loadu_si128((const __m128i*)&K[4*g]));
+			state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+			state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0e));
+		}
+		state0 = _mm_add_epi32(state0, abef);
+		state1 = _mm_add_epi32(state1, cdgh);
+	}
+
+	tmp = _mm_shuffle_epi32(state0, 0x1b); /* FEBA */
+	state1 = _mm_shuffle_epi32(state1, 0xb1); /* DCHG */
+	state0 = _mm_blend_epi16(tmp, state1, 0xf0); /* DCBA */
+	state1 = _mm_alignr_epi8(state1, tmp, 8); /* HGFE */
+	_mm_storeu_si128((__m128i*)&h[0], state0);
+	_mm_storeu_si128((__m128i*)&h[4], state1);
+}
+
+static int
+cpu_has_shani(void)
+{
+	unsigned a, b, c, d;
+	if (!__get_cpuid(1, &a, &b, &c, &d) || !(c & bit_SSE4_1) || !(c & bit_SSSE3))
+		return 0;
+	if (!__get_cpuid_count(7, 0, &a, &b, &c, &d))
+		return 0;
+	return (b & (1u << 29)) != 0; /* SHA */
+}
+#endif /* #ifdef ZSHA256_SHANI */
+
+static void
+blocks(uint32_t h[8], const zbyte*const p, const size_t nblocks)
+{
+#ifdef ZSHA256_SHANI
+	static atomic_int shani = -1; /* -1 means we haven't asked the CPU yet */
+	int have = atomic_load_explicit(&shani, memory_order_relaxed);
+	if (have < 0) {
+		have = cpu_has_shani();
+		atomic_store_explicit(&shani, have, memory_order_relaxed);
+	}
+	if (have) {
+		blocks_shani(h, p, nblocks);
+		return;
+	}
+#endif
+	blocks_portable(h, p, nblocks);
+}
+
+void
+zsha256_init(zsha256_ctx*const ctx)
+{
+	static const uint32_t IV[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+	};
+	assert (ctx != NULL); /* @precondition */
+	memcpy(ctx->h, IV, sizeof(IV));
+	ctx->len = 0;
+	ctx->buflen = 0;
+}
+
+void
+zsha256_update(zsha256_ctx*const ctx, const czstr cz)
+{
+	const zbyte* p = cz.buf;
+	size_t len = cz.len;
+	size_t take;
+	assert (ctx != NULL); /* @precondition */
+
+	if (len == 0)
+		return;
+	ctx->len += len;
+	if (ctx->buflen > 0) {
+		take = MIN(64 - ctx->buflen, len);
+		memcpy(ctx->buf + ctx->buflen, p, take);
+		ctx->buflen += take;
+		p += take;
+		len -= take;
+		if (ctx->buflen < 64)
+			return;
+		blocks(ctx->h, ctx->buf, 1);
+		ctx->buflen = 0;
+	}
+	if (len >= 64) {
+		blocks(ctx->h, p, len / 64);
+		p += len & ~(size_t)63;
+		len &= 63;
+	}
+	if (len > 0) {
+		memcpy(ctx->buf, p, len);
+		ctx->buflen = len;
+	}
+}
+
+void
+zsha256_final(zsha256_ctx*const ctx, zbyte out[ZSHA256_LEN])
+{
+	const unsigned long long bits = ctx->len * 8;
+	int i;
+	assert (ctx != NULL); /* @precondition */
+
+	ctx->buf[ctx->buflen++] = 0x80;
+	if (ctx->buflen > 56) {
+		memset(ctx->buf + ctx->buflen, 0, 64 - ctx->buflen);
+		blocks(ctx->h, ctx->buf, 1);
+		ctx->buflen = 0;
+	}
+	memset(ctx->buf + ctx->buflen, 0, 56 - ctx->buflen);
+	uint32_encode((unsigned)(bits >> 32), ctx->buf + 56);
+	uint32_encode((unsigned)(bits & 0xffffffffUL), ctx->buf + 60);
+	blocks(ctx->h, ctx->buf, 1);
+	for (i = 0; i < 8; i++)
+		uint32_encode(ctx->h[i], out + 4*i);
+}
+
+void
+zsha256(const czstr cz, zbyte out[ZSHA256_LEN])
+{
+	zsha256_ctx ctx;
+	zsha256_init(&ctx);
+	zsha256_update(&ctx, cz);
+	zsha256_final(&ctx, out);
+}
+
+static const size_t STREAMBUF = 65536;
+
+void
+zsha256_stream(FILE*const fp, zbyte out[ZSHA256_LEN])
+{
+	zsha256_ctx ctx;
+	zbyte* buf;
+	size_t res;
+	assert (fp != NULL); /* @precondition */
+
+	buf = (zbyte*)malloc(STREAMBUF);
+	CHECKMALLOCEXIT(buf);
+	zsha256_init(&ctx);
+	while ((res = fread(buf, sizeof(zbyte), STREAMBUF, fp)) > 0)
+		zsha256_update(&ctx, (czstr){ res, buf });
+	runtime_assert(!ferror(fp), "file error");
+	zsha256_final(&ctx, out);
+	free(buf);
+}
+
+   /** tree mode */
+
+static const zbyte LEAFTAG = 0x00;
+static const zbyte NODETAG = 0x01;
+
+static void
+leaf_hash(const zbyte*const p, const size_t len, zbyte out[ZSHA256_LEN])
+{
+	zsha256_ctx ctx;
+	zsha256_init(&ctx);
+	zsha256_update(&ctx, (czstr){ 1, &LEAFTAG });
+	zsha256_update(&ctx, (czstr){ len, p });
+	zsha256_final(&ctx, out);
+}
+
+/** out may be the same as left or right. */
+static void
+node_hash(const zbyte left[ZSHA256_LEN], const zbyte right[ZSHA256_LEN], zbyte out[ZSHA256_LEN])
+{
+	zsha256_ctx ctx;
+	zsha256_init(&ctx);
+	zsha256_update(&ctx, (czstr){ 1, &NODETAG });
+	zsha256_update(&ctx, (czstr){ ZSHA256_LEN, left });
+	zsha256_update(&ctx, (czstr){ ZSHA256_LEN, right });
+	zsha256_final(&ctx, out);
+}
+
+/**
+ * Add the next leaf's hash, then merge subtrees of equal size, like carrying
+ * in binary addition.
+ */
+static void
+push_leaf(ztree_ctx*const t, const zbyte h[ZSHA256_LEN])
+{
+	unsigned n;
+	runtime_assert(t->nroots < 64, "Too many leaves.");
+	memcpy(t->root[t->nroots], h, ZSHA256_LEN);
+	t->level[t->nroots] = 0;
+	t->nroots++;
+	t->nleaves++;
+	while (((n = t->nroots) >= 2) && (t->level[n-1] == t->level[n-2])) {
+		node_hash(t->root[n-2], t->root[n-1], t->root[n-2]);
+		t->level[n-2]++;
+		t->nroots--;
+	}
+}
+
+static void
+begin_leaf(ztree_ctx*const t)
+{
+	zsha256_init(&t->leaf);
+	zsha256_update(&t->leaf, (czstr){ 1, &LEAFTAG });
+	t->leaflen = 0;
+}
+
+void
+ztree_init(ztree_ctx*const ctx)
+{
+	assert (ctx != NULL); /* @precondition */
+	ctx->nleaves = 0;
+	ctx->nroots = 0;
+	begin_leaf(ctx);
+}
+
+void
+ztree_update(ztree_ctx*const ctx, const czstr cz)
+{
+	const zbyte* p = cz.buf;
+	size_t len = cz.len;
+	size_t take;
+	zbyte h[ZSHA256_LEN];
+	assert (ctx != NULL); /* @precondition */
+
+	while (len > 0) {
+		take = MIN(ZTREE_LEAF - ctx->leaflen, len);
+		zsha256_update(&ctx->leaf, (czstr){ take, p });
+		ctx->leaflen += take;
+		p += take;
+		len -= take;
+		if (ctx->leaflen == ZTREE_LEAF) {
+			zsha256_final(&ctx->leaf, h);
+			push_leaf(ctx, h);
+			begin_leaf(ctx);
+		}
+	}
+}
+
+void
+ztree_final(ztree_ctx*const ctx, zbyte out[ZSHA256_LEN])
+{
+	zbyte h[ZSHA256_LEN];
+	int i;
+	assert (ctx != NULL); /* @precondition */
+
+	if ((ctx->leaflen > 0) || (ctx->nleaves == 0)) {
+		zsha256_final(&ctx->leaf, h);
+		push_leaf(ctx, h);
+	}
+	/* Fold the subtrees together from the smallest (rightmost) up, which
+	 * gives the RFC 6962 shape. */
+	memcpy(h, ctx->root[ctx->nroots - 1], ZSHA256_LEN);
+	for (i = (int)ctx->nroots - 2; i >= 0; i--)
+		node_hash(ctx->root[i], h, h);
+	memcpy(out, h, ZSHA256_LEN);
+}
+
+typedef struct {
+	czstr data;
+	size_t first; /* the first leaf for this thread */
+	size_t last; /* one past its last leaf */
+	zbyte (*hashes)[ZSHA256_LEN];
+} leafjob;
+
+static void*
+hash_leaves(void*const arg)
+{
+	const leafjob*const j = (const leafjob*)arg;
+	size_t i, off;
+	for (i = j->first; i < j->last; i++) {
+		off = i * ZTREE_LEAF;
+		leaf_hash(j->data.buf + off, MIN((size_t)ZTREE_LEAF, j->data.len - off), j->hashes[i]);
+	}
+	return NULL;
+}
+
+void
+ztree(const czstr cz, size_t nthreads, zbyte out[ZSHA256_LEN])
+{
+	const size_t nleaves = (cz.len == 0) ? 1 : (cz.len + ZTREE_LEAF - 1) / ZTREE_LEAF;
+	zbyte (*hashes)[ZSHA256_LEN];
+	leafjob* jobs;
+	ztree_ctx t;
+	size_t i;
+
+	if (nthreads > nleaves)
+		nthreads = nleaves;
+	if (nthreads <= 1) {
+		ztree_init(&t);
+		ztree_update(&t, cz);
+		ztree_final(&t, out);
+		return;
+	}
+
+	hashes = (zbyte (*)[ZSHA256_LEN])malloc(nleaves * ZSHA256_LEN);
+	CHECKMALLOCEXIT(hashes);
+	jobs = (leafjob*)malloc(nthreads * sizeof(leafjob));
+	CHECKMALLOCEXIT(jobs);
+
+	for (i = 0; i < nthreads; i++) {
+		jobs[i].data = cz;
+		jobs[i].first = nleaves * i / nthreads;
+		jobs[i].last = nleaves * (i + 1) / nthreads;
+		jobs[i].hashes = hashes;
+	}
+	z_run_shares(hash_leaves, jobs, sizeof(leafjob), nthreads);
+
+	ztree_init(&t);
+	for (i = 0; i < nleaves; i++)
+		push_leaf(&t, hashes[i]);
+	ztree_final(&t, out);
+
+	free(jobs);
+	free(hashes);
+}
+
+void
+ztree_stream(FILE*const fp, zbyte out[ZSHA256_LEN])
+{
+	ztree_ctx t;
+	zbyte* buf;
+	size_t res;
+	assert (fp != NULL); /* @precondition */
+
+	buf = (zbyte*)malloc(STREAMBUF);
+	CHECKMALLOCEXIT(buf);
+	ztree_init(&t);
+	while ((res = fread(buf, sizeof(zbyte), STREAMBUF, fp)) > 0)
+		ztree_update(&t, (czstr){ res, buf });
+	runtime_assert(!ferror(fp), "file error");
+	ztree_final(&t, out);
+	free(buf);
+}
+
+/**
+ * Copyright (c) 2002-2004 Bryce "Zooko" Wilcox-O'Hearn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software to deal in this software without restriction, including
+ * without limitation the rights to use, modify, distribute, sublicense, and/or
+ * sell copies of this software, and to permit persons to whom this software is
+ * furnished to do so, provided that the above copyright notice and this
+ * permission notice is included in all copies or substantial portions of this
+ * software. THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED.
+ */
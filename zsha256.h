@@ -0,0 +1,136 @@
+/**
+ * copyright 2002-2004 Bryce "Zooko" Wilcox-O'Hearn
+ * mailto:zooko@zooko.com
+ *
+ * See the end of this file for the simple, permissive free software, open
+ * source license.
+ *
+ * About this module:
+ *
+ * SHA-256 of czstrs and streams, plus a tree mode for big inputs.  On x86-64
+ * CPUs with the SHA extensions it uses the sha256rnds2 instructions, and
+ * elsewhere (or if ZSHA256_PORTABLE is defined at compile time) plain C.
+ *
+ * Plain SHA-256 is inherently serial.  The tree mode instead splits the
+ * input into leaves of ZTREE_LEAF bytes and hashes them into a Merkle tree
+ * shaped as in RFC 6962:
+ *
+ *     leaf hash = SHA-256(0x00 || leaf)
+ *     node hash = SHA-256(0x01 || left || right)
+ *
+ * where, for n leaves, the left subtree holds the largest power of 2 fewer
+ * than n.  (The empty input is one empty leaf.)  The leaves can be hashed
+ * in parallel, and the root depends only on the input, not on the number of
+ * threads or on how the input was fed to ztree_update().  Note that the tree
+ * root is not the same as the SHA-256 of the input.
+ */
+#ifndef _INCL_zsha256_h
+#define _INCL_zsha256_h
+
+#include <stdint.h>
+
+#include "zstr.h"
+
+#define ZSHA256_LEN 32
+
+/** The tree mode's leaf size, in bytes. */
+#define ZTREE_LEAF (1024 * 1024)
+
+typedef struct {
+	uint32_t h[8];
+	unsigned long long len; /* bytes hashed so far */
+	zbyte buf[64]; /* the incomplete block */
+	size_t buflen;
+} zsha256_ctx;
+
+/**
+ * Begin hashing.  Then call zsha256_update() any number of times, then
+ * zsha256_final().
+ *
+ * @precondition ctx must not be NULL.
+ */
+void
+zsha256_init(zsha256_ctx* ctx);
+
+void
+zsha256_update(zsha256_ctx* ctx, czstr cz);
+
+/**
+ * Write the digest to out.  ctx must be zsha256_init()ed again before it is
+ * reused.
+ */
+void
+zsha256_final(zsha256_ctx* ctx, zbyte out[ZSHA256_LEN]);
+
+/**
+ * Write the SHA-256 digest of cz to out.
+ */
+void
+zsha256(czstr cz, zbyte out[ZSHA256_LEN]);
+
+/**
+ * Write the SHA-256 digest of the rest of fp, until EOF, to out.  This does
+ * not fclose() fp.
+ *
+ * @precondition fp must not be NULL.
+ */
+void
+zsha256_stream(FILE* fp, zbyte out[ZSHA256_LEN]);
+
+typedef struct {
+	zsha256_ctx leaf; /* the leaf being hashed */
+	size_t leaflen; /* bytes so far in that leaf */
+	unsigned long long nleaves; /* completed leaves */
+	/* The roots of the complete subtrees so far, biggest first.  Subtree
+	 * i holds 2^level[i] leaves. */
+	zbyte root[64][ZSHA256_LEN];
+	unsigned level[64];
+	unsigned nroots;
+} ztree_ctx;
+
+/**
+ * Begin hashing in tree mode.  Then call ztree_update() any number of times,
+ * then ztree_final().
+ *
+ * @precondition ctx must not be NULL.
+ */
+void
+ztree_init(ztree_ctx* ctx);
+
+void
+ztree_update(ztree_ctx* ctx, czstr cz);
+
+void
+ztree_final(ztree_ctx* ctx, zbyte out[ZSHA256_LEN]);
+
+/**
+ * Write the tree-mode root of cz to out, hashing the leaves on nthreads
+ * threads.  The result is the same for any nthreads.
+ */
+void
+ztree(czstr cz, size_t nthreads, zbyte out[ZSHA256_LEN]);
+
+/**
+ * Write the tree-mode root of the rest of fp, until EOF, to out.  This does
+ * not fclose() fp.
+ *
+ * @precondition fp must not be NULL.
+ */
+void
+ztree_stream(FILE* fp, zbyte out[ZSHA256_LEN]);
+
+#endif /* #ifndef _INCL_zsha256_h */
+
+
+/**
+ * Copyright (c) 2002-2004 Bryce "Zooko" Wilcox-O'Hearn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software to deal in this software without restriction, including
+ * without limitation the rights to use, modify, distribute, sublicense, and/or
+ * sell copies of this software, and to permit persons to whom this software is
+ * furnished to do so, provided that the above copyright notice and this
+ * permission notice is included in all copies or substantial portions of this
+ * software. THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED.
+ */
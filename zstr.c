@@ -8,12 +8,20 @@
 #include <ctype.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <string.h>
 #include <assert.h>
+#include <stdatomic.h>
 
 #include "moreassert.h"
 
 #include "zstr.h"
+#include "zinternal.h"
+
+#if defined(__SSE2__) && (defined(__GNUC__) || defined(__clang__))
+#define ZSTR_SSE2
+#include <emmintrin.h>
+#endif
 
 /** commonly used functions */
 
@@ -41,6 +49,624 @@ zcat(zstr z1, const czstr z2)
 	return (zstr){ z1.len+z2.len, p };
 }
 
+/**
+ * Copy len bytes from src to dst.  Unlike memcpy(), src may be NULL when len
+ * is 0, as it is in the empty czstr { 0, NULL }.
+ *
+ * @return dst + len
+ */
+static zbyte*
+copy_bytes(zbyte*const dst, const zbyte*const src, const size_t len)
+{
+	if (len == 0)
+		return dst;
+	memcpy(dst, src, len);
+	return dst + len;
+}
+
+zstr
+zjoin(const czstr*const zs, const size_t n, const czstr sep)
+{
+	size_t i, total;
+	zbyte* p;
+	zstr result;
+	assert ((zs != NULL) || (n == 0)); /* @precondition */
+
+	if (n == 0) {
+		return (zstr){ 0, NULL };
+	}
+	total = sep.len * (n-1);
+	for (i = 0; i < n; i++) {
+		total += zs[i].len;
+	}
+	if (total == 0) {
+		return (zstr){ 0, NULL };
+	}
+
+	result = new_z(total);
+	if (result.buf == NULL)
+		return result;
+
+	p = copy_bytes(result.buf, zs[0].buf, zs[0].len);
+	for (i = 1; i < n; i++) {
+		p = copy_bytes(p, sep.buf, sep.len);
+		p = copy_bytes(p, zs[i].buf, zs[i].len);
+	}
+	assert (p == result.buf + total); /* error internal to this function */
+	return result;
+}
+
+/* Below this many bytes per thread, zjoin_parallel() isn't worth its 
+ * threads. */
+static const size_t JOIN_SHARE_MIN = 4 * 1024 * 1024;
+
+/**
+ * One thread's share of a zjoin_parallel(): the bytes [lo, hi) of the 
+ * result, wherever they come from.
+ */
+typedef struct {
+	const czstr* zs;
+	size_t n;
+	czstr sep;
+	const size_t* offs; /* offs[i] is where zs[i] goes in out */
+	zbyte* out;
+	size_t lo, hi;
+} joinshare;
+
+/**
+ * Copy the part of src, which goes at out + at, that falls in [lo, hi).
+ */
+static void
+copy_clipped(zbyte*const out, const size_t at, const zbyte*const src, const size_t len, const size_t lo, const size_t hi)
+{
+	const size_t s = (at > lo) ? at : lo;
+	const size_t e = (at + len < hi) ? at + len : hi;
+	if (s < e)
+		memcpy(out + s, src + (s - at), e - s);
+}
+
+static void*
+join_share(void*const arg)
+{
+	const joinshare*const j = (const joinshare*)arg;
+	size_t i, lo = 0, hi = j->n;
+
+	/* Find the last piece starting at or before j->lo. */
+	while (hi - lo > 1) {
+		i = lo + (hi - lo) / 2;
+		if (j->offs[i] <= j->lo)
+			lo = i;
+		else
+			hi = i;
+	}
+	for (i = lo; i < j->n; i++) {
+		if (i > 0) {
+			if (j->offs[i] - j->sep.len >= j->hi)
+				break;
+			copy_clipped(j->out, j->offs[i] - j->sep.len, j->sep.buf, j->sep.len, j->lo, j->hi);
+		}
+		copy_clipped(j->out, j->offs[i], j->zs[i].buf, j->zs[i].len, j->lo, j->hi);
+	}
+	return NULL;
+}
+
+zstr
+zjoin_parallel(const czstr*const zs, const size_t n, const czstr sep, size_t nthreads)
+{
+	joinshare* shares;
+	size_t* offs;
+	size_t i, k, total;
+	zstr result;
+	assert ((zs != NULL) || (n == 0)); /* @precondition */
+
+	if (n == 0)
+		return (zstr){ 0, NULL };
+	offs = (size_t*)malloc(n * sizeof(size_t));
+#ifdef Z_EXHAUST_EXIT
+	CHECKMALLOCEXIT(offs);
+#else
+	if (offs == NULL)
+		return (zstr){ 0, NULL };
+#endif
+	total = 0;
+	for (i = 0; i < n; i++) {
+		if (i > 0)
+			total += sep.len;
+		offs[i] = total;
+		total += zs[i].len;
+	}
+	if (nthreads > total / JOIN_SHARE_MIN)
+		nthreads = total / JOIN_SHARE_MIN;
+	if (nthreads <= 1) {
+		free(offs);
+		return zjoin(zs, n, sep);
+	}
+
+	result = new_z(total);
+	if (result.buf == NULL) {
+		free(offs);
+		return result;
+	}
+	shares = (joinshare*)malloc(nthreads * sizeof(joinshare));
+#ifdef Z_EXHAUST_EXIT
+	CHECKMALLOCEXIT(shares);
+#else
+	if (shares == NULL) {
+		free_z(result);
+		free(offs);
+		return (zstr){ 0, NULL };
+	}
+#endif
+	for (k = 0; k < nthreads; k++)
+		shares[k] = (joinshare){ zs, n, sep, offs, result.buf, total / nthreads * k, (k + 1 == nthreads) ? total : total / nthreads * (k + 1) };
+	z_run_shares(join_share, shares, sizeof(joinshare), nthreads);
+	free(shares);
+	free(offs);
+	return result;
+}
+
+zstr
+zcatn(const size_t n, ...)
+{
+	va_list ap, ap2;
+	size_t i, total;
+	czstr z;
+	zbyte* p;
+	zstr result;
+
+	va_start(ap, n);
+	va_copy(ap2, ap);
+	total = 0;
+	for (i = 0; i < n; i++) {
+		total += va_arg(ap, czstr).len;
+	}
+	va_end(ap);
+	if (total == 0) {
+		va_end(ap2);
+		return (zstr){ 0, NULL };
+	}
+
+	result = new_z(total);
+	if (result.buf == NULL) {
+		va_end(ap2);
+		return result;
+	}
+
+	p = result.buf;
+	for (i = 0; i < n; i++) {
+		z = va_arg(ap2, czstr);
+		p = copy_bytes(p, z.buf, z.len);
+	}
+	va_end(ap2);
+	assert (p == result.buf + total); /* error internal to this function */
+	return result;
+}
+
+const zbyte*
+zfind(const czstr haystack, const czstr needle)
+{
+	const zbyte* p = haystack.buf;
+	const zbyte* last;
+	assert (needle.len != 0); /* @precondition */
+
+	if (needle.len > haystack.len)
+		return NULL;
+	last = haystack.buf + (haystack.len - needle.len);
+	while (p <= last) {
+		p = (const zbyte*)memchr(p, needle.buf[0], (last - p) + 1);
+		if (p == NULL)
+			return NULL;
+		if (!memcmp(p+1, needle.buf+1, needle.len-1))
+			return p;
+		p++;
+	}
+	return NULL;
+}
+
+/**
+ * A needle prepared for repeated searching.  Needles of at least 
+ * HORSPOOL_MIN bytes are searched with Horspool's algorithm, which can skip 
+ * up to needle.len bytes per step; shorter needles use zfind(), whose memchr() 
+ * is hard to beat when the skips would be that small.  Where SSE2 is 
+ * available, long needles instead check 16 positions at a time for the 
+ * needle's first and last bytes, and use Horspool only for the last few.
+ */
+typedef struct {
+	czstr needle;
+	size_t skip[256];
+} finder;
+
+static const size_t HORSPOOL_MIN = 4;
+
+static void
+finder_init(finder*const f, const czstr needle)
+{
+	size_t i;
+	assert (needle.len != 0); /* @precondition */
+	f->needle = needle;
+	if (needle.len < HORSPOOL_MIN)
+		return;
+	for (i = 0; i < 256; i++)
+		f->skip[i] = needle.len;
+	for (i = 0; i < needle.len - 1; i++)
+		f->skip[needle.buf[i]] = needle.len - 1 - i;
+}
+
+static const zbyte*
+finder_find(const finder*const f, const zbyte* p, const zbyte*const end)
+{
+	const size_t nlen = f->needle.len;
+	const zbyte last = f->needle.buf[nlen-1];
+	zbyte c;
+
+	if (nlen < HORSPOOL_MIN)
+		return zfind((czstr){ end - p, p }, f->needle);
+#ifdef ZSTR_SSE2
+	{
+		const __m128i first = _mm_set1_epi8((char)f->needle.buf[0]);
+		const __m128i lastv = _mm_set1_epi8((char)last);
+		unsigned mask, i;
+		while ((size_t)(end - p) >= nlen + 15) {
+			mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(
+				_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), first),
+				_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + nlen - 1)), lastv)));
+			while (mask != 0) {
+				i = (unsigned)__builtin_ctz(mask);
+				if (!memcmp(p + i + 1, f->needle.buf + 1, nlen - 2))
+					return p + i;
+				mask &= mask - 1;
+			}
+			p += 16;
+		}
+	}
+#endif
+	while ((size_t)(end - p) >= nlen) {
+		c = p[nlen-1];
+		if ((c == last) && !memcmp(p, f->needle.buf, nlen-1))
+			return p;
+		p += f->skip[c];
+	}
+	return NULL;
+}
+
+/**
+ * A set of needles prepared for finding the leftmost match of any of them.  
+ * Candidates are positions whose first byte (and second, for needles that 
+ * have one) begin some needle; each candidate is tried against every 
+ * needle.  Where SSE2 is available and there are at most MULTI_SSE_MAX 
+ * distinct such prefixes, 16 positions are screened at a time, one pair 
+ * of vector compares per prefix.  Otherwise a one-byte-per-step scan checks 
+ * each byte against a table of first bytes (or memchr()s for the first byte, 
+ * if all the needles share it), which costs O(z.len) plus O(n) for each 
+ * candidate.
+ */
+#define MULTI_SSE_MAX 8
+
+typedef struct {
+	const czstr* needles;
+	size_t n;
+	zbyte firsts[256]; /* firsts[c] is non-zero iff some needle begins with c */
+	int nfirsts; /* the number of distinct first bytes */
+	zbyte first; /* the first byte, if nfirsts is 1 */
+	size_t nprefixes; /* distinct prefixes, or 0 if more than MULTI_SSE_MAX */
+	zbyte pfirst[MULTI_SSE_MAX];
+	zbyte psecond[MULTI_SSE_MAX];
+	zbyte pboth[MULTI_SSE_MAX]; /* 1 if the prefix has two bytes, 0 if one */
+} multifinder;
+
+static void
+multifinder_init(multifinder*const f, const czstr*const needles, const size_t n)
+{
+	size_t i, j;
+	zbyte c, c2, both;
+	int toomany = 0;
+
+	f->needles = needles;
+	f->n = n;
+	memset(f->firsts, 0, sizeof(f->firsts));
+	f->nfirsts = 0;
+	f->nprefixes = 0;
+	for (i = 0; i < n; i++) {
+		assert (needles[i].len != 0); /* @precondition */
+		c = needles[i].buf[0];
+		if (!f->firsts[c]) {
+			f->firsts[c] = 1;
+			f->nfirsts++;
+			f->first = c;
+		}
+		/* A one-byte needle matches wherever its byte does, which covers 
+		 * every longer needle that begins with it. */
+		both = (needles[i].len > 1);
+		c2 = both ? needles[i].buf[1] : 0;
+		for (j = 0; j < f->nprefixes; j++) {
+			if ((f->pfirst[j] == c) && (!f->pboth[j] || (both && (f->psecond[j] == c2))))
+				break;
+		}
+		if (j < f->nprefixes)
+			continue;
+		if (f->nprefixes == MULTI_SSE_MAX) {
+			toomany = 1;
+			continue;
+		}
+		f->pfirst[j] = c;
+		f->psecond[j] = c2;
+		f->pboth[j] = both;
+		f->nprefixes++;
+	}
+	if (toomany)
+		f->nprefixes = 0;
+}
+
+/**
+ * @return the first needle that matches at p, with *which set to its index, 
+ *     or NULL
+ */
+static const zbyte*
+multifinder_try(const multifinder*const f, const zbyte*const p, const zbyte*const end, size_t*const which)
+{
+	size_t i;
+	for (i = 0; i < f->n; i++) {
+		if ((f->needles[i].len <= (size_t)(end - p)) && (p[0] == f->needles[i].buf[0]) && !memcmp(p, f->needles[i].buf, f->needles[i].len)) {
+			*which = i;
+			return p;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Find the leftmost position in [p, end) at which one of the needles matches.
+ *
+ * @return the position, with *which set to the index of the needle, or NULL
+ */
+static const zbyte*
+multifinder_find(const multifinder*const f, const zbyte* p, const zbyte*const end, size_t*const which)
+{
+#ifdef ZSTR_SSE2
+	if (f->nprefixes != 0) {
+		__m128i firstv[MULTI_SSE_MAX], secondv[MULTI_SSE_MAX];
+		__m128i b0, b1, hit;
+		unsigned mask, i;
+		size_t j;
+		for (j = 0; j < f->nprefixes; j++) {
+			firstv[j] = _mm_set1_epi8((char)f->pfirst[j]);
+			secondv[j] = _mm_set1_epi8((char)f->psecond[j]);
+		}
+		while ((size_t)(end - p) >= 17) {
+			b0 = _mm_loadu_si128((const __m128i*)p);
+			b1 = _mm_loadu_si128((const __m128i*)(p + 1));
+			hit = _mm_setzero_si128();
+			for (j = 0; j < f->nprefixes; j++) {
+				if (f->pboth[j])
+					hit = _mm_or_si128(hit, _mm_and_si128(_mm_cmpeq_epi8(b0, firstv[j]), _mm_cmpeq_epi8(b1, secondv[j])));
+				else
+					hit = _mm_or_si128(hit, _mm_cmpeq_epi8(b0, firstv[j]));
+			}
+			mask = (unsigned)_mm_movemask_epi8(hit);
+			while (mask != 0) {
+				i = (unsigned)__builtin_ctz(mask);
+				if (multifinder_try(f, p + i, end, which) != NULL)
+					return p + i;
+				mask &= mask - 1;
+			}
+			p += 16;
+		}
+	}
+#endif
+	if (f->nfirsts == 1) {
+		while (p < end) {
+			p = (const zbyte*)memchr(p, f->first, end - p);
+			if (p == NULL)
+				return NULL;
+			if (multifinder_try(f, p, end, which) != NULL)
+				return p;
+			p++;
+		}
+		return NULL;
+	}
+	for (; p < end; p++) {
+		if (f->firsts[*p] && (multifinder_try(f, p, end, which) != NULL))
+			return p;
+	}
+	return NULL;
+}
+
+/**
+ * The matches that the counting pass of a replace found, so that the copying 
+ * pass needn't search again.  To bound the extra memory, it holds at most 
+ * about one match per 64 bytes of the subject; matches past that (or past a 
+ * failed malloc()) aren't recorded, and the copying pass searches for them.
+ */
+typedef struct {
+	const zbyte* at;
+	size_t which;
+} match;
+
+typedef struct {
+	match* v;
+	size_t n;
+	size_t cap;
+	size_t max;
+	match local[32];
+} matchlist;
+
+static void
+ml_init(matchlist*const ml, const size_t subjectlen)
+{
+	ml->v = ml->local;
+	ml->n = 0;
+	ml->cap = sizeof(ml->local) / sizeof(ml->local[0]);
+	ml->max = ml->cap + subjectlen / 64;
+}
+
+static void
+ml_push(matchlist*const ml, const zbyte*const at, const size_t which)
+{
+	match* v;
+	size_t newcap;
+	if (ml->n == ml->cap) {
+		if (ml->cap == ml->max)
+			return;
+		newcap = (2 * ml->cap < ml->max) ? 2 * ml->cap : ml->max;
+		v = (match*)malloc(newcap * sizeof(match));
+		if (v == NULL) {
+			ml->max = ml->cap;
+			return;
+		}
+		memcpy(v, ml->v, ml->n * sizeof(match));
+		if (ml->v != ml->local)
+			free(ml->v);
+		ml->v = v;
+		ml->cap = newcap;
+	}
+	ml->v[ml->n++] = (match){ at, which };
+}
+
+static void
+ml_free(matchlist*const ml)
+{
+	if (ml->v != ml->local)
+		free(ml->v);
+}
+
+zstr
+zreplace_many(const czstr z, const czstr*const needles, const czstr*const repls, const size_t n)
+{
+	const zbyte*const end = z.buf + z.len;
+	const zbyte* p;
+	const zbyte* m;
+	zbyte* resp;
+	size_t i, which, count, len;
+	matchlist ml;
+	multifinder f;
+	zstr result;
+	assert ((needles != NULL) && (repls != NULL)); /* @precondition */
+
+	if (n == 1)
+		return zreplace(z, needles[0], repls[0]);
+
+	multifinder_init(&f, needles, n);
+	ml_init(&ml, z.len);
+	count = 0;
+	len = z.len;
+	p = z.buf;
+	while ((m = multifinder_find(&f, p, end, &which)) != NULL) {
+		ml_push(&ml, m, which);
+		count++;
+		len = len - needles[which].len + repls[which].len;
+		p = m + needles[which].len;
+	}
+	if (len == 0) {
+		ml_free(&ml);
+		return (zstr){ 0, NULL };
+	}
+
+	result = new_z(len);
+	if (result.buf == NULL) {
+		ml_free(&ml);
+		return result;
+	}
+
+	resp = result.buf;
+	p = z.buf;
+	for (i = 0; i < count; i++) {
+		if (i < ml.n) {
+			m = ml.v[i].at;
+			which = ml.v[i].which;
+		} else {
+			m = multifinder_find(&f, p, end, &which);
+		}
+		resp = copy_bytes(resp, p, m - p);
+		resp = copy_bytes(resp, repls[which].buf, repls[which].len);
+		p = m + needles[which].len;
+	}
+	resp = copy_bytes(resp, p, end - p);
+	assert (resp == result.buf + len); /* error internal to this function */
+	ml_free(&ml);
+	return result;
+}
+
+zstr
+zreplace(const czstr z, const czstr needle, const czstr repl)
+{
+	const zbyte*const end = z.buf + z.len;
+	const zbyte* p;
+	const zbyte* m;
+	zbyte* resp;
+	size_t i, count, len;
+	matchlist ml;
+	finder f;
+	zstr result;
+	assert (needle.len != 0); /* @precondition */
+
+	finder_init(&f, needle);
+	ml_init(&ml, z.len);
+	count = 0;
+	p = z.buf;
+	while ((m = finder_find(&f, p, end)) != NULL) {
+		ml_push(&ml, m, 0);
+		count++;
+		p = m + needle.len;
+	}
+	len = z.len - count*needle.len + count*repl.len;
+	if (len == 0) {
+		ml_free(&ml);
+		return (zstr){ 0, NULL };
+	}
+
+	result = new_z(len);
+	if (result.buf == NULL) {
+		ml_free(&ml);
+		return result;
+	}
+
+	resp = result.buf;
+	p = z.buf;
+	for (i = 0; i < count; i++) {
+		m = (i < ml.n) ? ml.v[i].at : finder_find(&f, p, end);
+		resp = copy_bytes(resp, p, m - p);
+		resp = copy_bytes(resp, repl.buf, repl.len);
+		p = m + needle.len;
+	}
+	resp = copy_bytes(resp, p, end - p);
+	assert (resp == result.buf + len); /* error internal to this function */
+	ml_free(&ml);
+	return result;
+}
+
+zstr
+zreplace_in_place(const zstr z, const czstr needle, const czstr repl)
+{
+	const zbyte*const end = z.buf + z.len;
+	const zbyte* p;
+	const zbyte* m;
+	zbyte* resp;
+	finder f;
+	assert (needle.len != 0); /* @precondition */
+	assert (repl.len <= needle.len); /* @precondition */
+
+	if (z.buf == NULL)
+		return z;
+	finder_init(&f, needle);
+
+	/* resp never gets ahead of p, so the unread part of z is never clobbered. */
+	resp = z.buf;
+	p = z.buf;
+	while ((m = finder_find(&f, p, end)) != NULL) {
+		memmove(resp, p, m - p);
+		resp += m - p;
+		if (repl.len != 0) {
+			memmove(resp, repl.buf, repl.len);
+			resp += repl.len;
+		}
+		p = m + needle.len;
+	}
+	memmove(resp, p, end - p);
+	resp += end - p;
+	*resp = '\0';
+	return (zstr){ resp - z.buf, z.buf };
+}
+
 zstr
 zdup(const czstr z1)
 {
@@ -323,7 +949,6 @@ z_decode(FILE* fp)
 	runtime_assert(res == 1, "fread() failed to read the length.");
 	result.len = (size_t)uint32_decode(len);
 	free(len);
-	printf("result.len = %d\n", result.len);
     result.buf = (zbyte*)malloc(result.len + 1);
 #ifdef Z_EXHAUST_EXIT
     CHECKMALLOCEXIT(result.buf);
@@ -345,16 +970,14 @@ void
 z_encode(czstr cz, FILE* fp)
 {
 	size_t res;
-	zbyte* len;
+	zbyte len[4];
 	assert(fp != NULL); /* @precondition */
 	
-	len = (zbyte*)malloc(4);
-	runtime_assert(len != NULL, "Memory exhaustion.");
 	uint32_encode(cz.len, len);
 	res = fwrite(len, sizeof(zbyte), 4, fp);
-	runtime_assert(res = 4, "fwrite() failed to completely write the data.");
+	runtime_assert(res == 4, "fwrite() failed to completely write the data.");
 	res = fwrite(cz.buf, sizeof(zbyte), cz.len, fp);
-	runtime_assert(res = cz.len, "fwrite() failed to completely write the data.");
+	runtime_assert(res == cz.len, "fwrite() failed to completely write the data.");
 }
 	
 void 
@@ -367,6 +990,133 @@ cz_to_stream(const czstr cz, FILE* fp)
 	runtime_assert(res == cz.len, "fwrite() failed to completely write the data.");
 }
 
+/** shared strings */
+
+struct zsbuf {
+	atomic_size_t refs;
+	zbyte* buf; /* either data, or an adopted zstr's buf */
+	zbyte data[];
+};
+
+static zsbuf*
+new_zsbuf(const size_t datalen)
+{
+	zsbuf* b = (zsbuf*)malloc(sizeof(zsbuf) + datalen);
+#ifdef Z_EXHAUST_EXIT
+	CHECKMALLOCEXIT(b);
+#else
+	if (b == NULL) {
+		return NULL;
+	}
+#endif
+	atomic_init(&b->refs, 1);
+	b->buf = b->data;
+	return b;
+}
+
+szstr
+new_sz(const czstr cz)
+{
+	zsbuf* b;
+	if (cz.len == 0) {
+		return (szstr){ 0, NULL, NULL };
+	}
+	b = new_zsbuf(cz.len+1);
+	if (b == NULL) {
+		return (szstr){ 0, NULL, NULL };
+	}
+	memcpy(b->buf, cz.buf, cz.len);
+	b->buf[cz.len] = '\0';
+	return (szstr){ cz.len, b->buf, b };
+}
+
+szstr
+sz_adopt_z(const zstr z)
+{
+	zsbuf* b;
+	if (z.buf == NULL) {
+		assert (z.len == 0);
+		return (szstr){ 0, NULL, NULL };
+	}
+	b = new_zsbuf(0);
+	if (b == NULL) {
+		return (szstr){ 0, NULL, NULL };
+	}
+	b->buf = z.buf;
+	return (szstr){ z.len, b->buf, b };
+}
+
+szstr
+sz_ref(const szstr sz)
+{
+	if (sz.owner != NULL) {
+		/* Relaxed is enough: the caller already holds a reference, so the 
+		 * buffer cannot go away underneath us. */
+		atomic_fetch_add_explicit(&sz.owner->refs, 1, memory_order_relaxed);
+	}
+	return sz;
+}
+
+szstr
+sz_slice(const szstr sz, const size_t off, const size_t len)
+{
+	assert (off <= sz.len); /* @precondition */
+	assert (len <= sz.len - off); /* @precondition */
+	if (len == 0) {
+		return (szstr){ 0, NULL, NULL };
+	}
+	sz_ref(sz);
+	return (szstr){ len, sz.buf + off, sz.owner };
+}
+
+void
+free_sz(const szstr sz)
+{
+	zsbuf*const b = sz.owner;
+	if (b == NULL)
+		return;
+	/* acq_rel, so that every other thread's use of the buffer before its own 
+	 * free_sz() happens before we free it. */
+	if (atomic_fetch_sub_explicit(&b->refs, 1, memory_order_acq_rel) == 1) {
+		if (b->buf != b->data)
+			free(b->buf);
+		free(b);
+	}
+}
+
+czstr
+sz_as_cz(const szstr sz)
+{
+	return (czstr){ sz.len, sz.buf };
+}
+
+zbyte*
+sz_mut(szstr*const sz)
+{
+	szstr copy;
+	assert (sz != NULL); /* @precondition */
+
+	if (sz->owner == NULL)
+		return NULL;
+	if (atomic_load_explicit(&sz->owner->refs, memory_order_acquire) == 1)
+		return (zbyte*)sz->buf;
+
+	copy = new_sz(sz_as_cz(*sz));
+	if (copy.buf == NULL)
+		return NULL;
+	free_sz(*sz);
+	*sz = copy;
+	return (zbyte*)sz->buf;
+}
+
+size_t
+sz_refcount(const szstr sz)
+{
+	if (sz.owner == NULL)
+		return 0;
+	return atomic_load_explicit(&sz.owner->refs, memory_order_relaxed);
+}
+
 int cz_check(const czstr cz)
 {
 	runtime_assert((cz.len == 0) == ((cz.buf == NULL) || (cz.buf[0] == '\0')), "If cz.len is 0 then cz.buf is required to be either NULL or a pointer to an array of length 1 containing a null char.");
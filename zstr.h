@@ -79,6 +79,7 @@ static char const* const zstr_vernum = "0.9.7";
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdarg.h>
 
 #define Z_EXHAUST_EXIT
 #include "zutil.h" /* http://sf.net/projects/libzutil */
@@ -120,6 +121,106 @@ typedef struct {
 zstr
 zcat(zstr z1, czstr z2);
 
+/**
+ * Concatenate n strings, with sep between each adjacent pair, into a newly 
+ * allocated zstr.  The total length is computed first, so this does exactly 
+ * one malloc() and copies each byte exactly once, whereas building the same 
+ * result with n calls to zcat() costs n realloc()s.
+ *
+ * @param zs an array of n czstrs (it may be NULL if n is 0)
+ * @param n the number of elements in zs
+ * @param sep the separator; pass (czstr){ 0, NULL } for no separator
+ *
+ * @return the new zstr, or a zstr with .buf NULL and .len 0 if the result 
+ *     would be empty
+ *
+ * On  malloc failure (if not Z_EXHAUST_EXIT) then it will return a zstr with 
+ * its .buf member set to NULL and its .len member set to 0.
+ */
+zstr
+zjoin(const czstr* zs, size_t n, czstr sep);
+
+/**
+ * Like zjoin(), but the copying is split among nthreads threads, each of 
+ * which writes its own range of the result.  This is for very large 
+ * results, whose copying is limited by one core's share of the memory 
+ * bandwidth; results with less than a few MiB per thread are joined with 
+ * fewer threads, down to plain zjoin().  It takes one more malloc() than 
+ * zjoin(), for the offsets of the pieces.
+ */
+zstr
+zjoin_parallel(const czstr* zs, size_t n, czstr sep, size_t nthreads);
+
+/**
+ * Like zjoin() with no separator, but the n czstrs are passed as arguments, 
+ * e.g. zcatn(3, a, b, c).
+ */
+zstr
+zcatn(size_t n, ...);
+
+/**
+ * Search for the first occurrence of needle in haystack.
+ *
+ * @return a pointer to the first byte of the match inside haystack.buf, or 
+ *     NULL if there is no match
+ *
+ * @precondition needle.len must not be 0.
+ */
+const zbyte*
+zfind(czstr haystack, czstr needle);
+
+/**
+ * Replace every non-overlapping occurrence of needle in z, scanning left to 
+ * right, with repl.  z is searched once to count the matches, and the result 
+ * is allocated at its exact size and filled in.  The search remembers where 
+ * the matches were so that the copying needn't search again; to bound that 
+ * memory it remembers at most about one match per 64 bytes of z (in an 
+ * array of 16 bytes per match, on the stack for the first 32), and matches 
+ * past that are searched for a second time.
+ *
+ * @return a newly allocated zstr holding the result (a copy of z if there are 
+ *     no matches), or a zstr with .buf NULL and .len 0 if the result is empty
+ *
+ * On  malloc failure (if not Z_EXHAUST_EXIT) then it will return a zstr with 
+ * its .buf member set to NULL and its .len member set to 0.
+ *
+ * @precondition needle.len must not be 0.
+ */
+zstr
+zreplace(czstr z, czstr needle, czstr repl);
+
+/**
+ * Like zreplace() but with n needles, each of which is replaced by the 
+ * corresponding element of repls, all in one pass.  At each position the 
+ * needles are tried in array order and the first one that matches wins.
+ *
+ * Where SSE2 is available and the needles have at most 8 distinct two-byte 
+ * prefixes, 16 positions are screened at a time for those prefixes; 
+ * otherwise z is scanned a byte at a time for the needles' first bytes.  
+ * Either way, every position that passes is tried against all n needles, so 
+ * needles sharing common prefixes cost up to O(z.len * n).
+ *
+ * @precondition none of the needles may have .len 0.
+ */
+zstr
+zreplace_many(czstr z, const czstr* needles, const czstr* repls, size_t n);
+
+/**
+ * Like zreplace(), but overwrites z instead of allocating.  This is possible 
+ * only because repl is not longer than needle, so the result is never longer 
+ * than z.
+ *
+ * @return z with its .len updated (.buf is unchanged, and is still 
+ *     null-terminated)
+ *
+ * @precondition needle.len must not be 0.
+ * @precondition repl.len must be <= needle.len.
+ * @precondition z.buf, unless it is NULL, must have room for z.len+1 bytes, 
+ *     since the terminator is written even if nothing matched.
+ */
+zstr
+zreplace_in_place(zstr z, czstr needle, czstr repl);
+
 /**
  * Copy z2 and return copy in newly allocated zstr..
  *
@@ -300,6 +401,101 @@ void cz_to_stream(czstr cz, FILE* fp);
  */
 int cz_check(czstr cz);
 
+   /** shared strings */
+
+/**
+ * An szstr is a length and a pointer into a reference-counted buffer.  Copying 
+ * an szstr with sz_ref() or taking a substring with sz_slice() shares the 
+ * buffer instead of copying it, and the buffer is freed when the last szstr 
+ * referring to it is passed to free_sz().  The reference count is atomic, so 
+ * different threads may each hold and free their own references to the same 
+ * buffer.
+ *
+ * The bytes are read-only through .buf; use sz_mut() to get a writable copy.  
+ * Note that an szstr produced by sz_slice() is generally not followed by a 
+ * null-terminating character.
+ *
+ * The empty szstr is { 0, NULL, NULL }, and all of the functions below accept 
+ * it.
+ */
+typedef struct zsbuf zsbuf; /* opaque */
+typedef struct {
+	size_t len; /* the length of the string */
+	const zbyte* buf; /* pointer to the first byte */
+	zsbuf* owner; /* the shared buffer that buf points into */
+} szstr;
+
+/**
+ * Allocates a new shared buffer and copies the contents of cz into it.
+ *
+ * On  malloc failure (if not Z_EXHAUST_EXIT) then it will return the empty 
+ * szstr.
+ */
+szstr
+new_sz(czstr cz);
+
+/**
+ * Take ownership of z, which must have been allocated by libzstr (or by 
+ * malloc()), without copying it.  You must not use or free z after this.
+ *
+ * On  malloc failure (if not Z_EXHAUST_EXIT) then it will return the empty 
+ * szstr, and z is unchanged.
+ */
+szstr
+sz_adopt_z(zstr z);
+
+/**
+ * @return a new reference to the same bytes as sz.  This does not copy.
+ */
+szstr
+sz_ref(szstr sz);
+
+/**
+ * @return a new reference to the len bytes of sz starting at off.  This does 
+ *     not copy, and the whole buffer behind sz stays alive for as long as the 
+ *     slice does.
+ *
+ * @precondition off + len must be <= sz.len.
+ */
+szstr
+sz_slice(szstr sz, size_t off, size_t len);
+
+/**
+ * Release this reference, freeing the buffer if it was the last one.
+ */
+void
+free_sz(szstr sz);
+
+/**
+ * @return a czstr view of sz.  It is valid only as long as sz is.
+ */
+czstr
+sz_as_cz(szstr sz);
+
+/**
+ * Copy-on-write: if *sz is the only reference to its buffer then return a 
+ * writable pointer to its bytes.  Else copy its bytes into a new buffer, 
+ * release the old reference, point *sz at the copy, and return a writable 
+ * pointer to that.
+ *
+ * @return NULL if *sz is the empty szstr.
+ *
+ * On  malloc failure (if not Z_EXHAUST_EXIT) then it will return NULL, and *sz 
+ * is unchanged.
+ *
+ * @precondition sz must not be NULL.
+ */
+zbyte*
+sz_mut(szstr* sz);
+
+/**
+ * @return the number of references to the buffer behind sz, or 0 for the 
+ *     empty szstr.  (By the time you look at it another thread may have 
+ *     changed it, so this is mostly useful for testing.)
+ */
+size_t
+sz_refcount(szstr sz);
+
 /*** macro definitions ***/
 
 typedef union { zstr z; czstr c; } z_union_zstr_czstr;
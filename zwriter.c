@@ -0,0 +1,210 @@
+/**
+ * copyright 2002-2004 Bryce "Zooko" Wilcox-O'Hearn
+ * mailto:zooko@zooko.com
+ *
+ * See the end of this file for the simple, permissive free software, open
+ * source license.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "moreassert.h"
+
+#include "zwriter.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+struct zwriter {
+	int fd;
+	int flags;
+	zbyte* buf; /* short strings are copied here */
+	size_t bufsize;
+	size_t buflen;
+	struct iovec iov[IOV_MAX]; /* everything queued, in order */
+	int niov;
+	zwriter_stats stats;
+};
+
+zwriter*
+new_zwriter(const int fd, const size_t bufsize, const int flags)
+{
+	zwriter* w;
+	assert (fd >= 0); /* @precondition */
+	assert (bufsize >= ZW_COPY_MAX); /* @precondition */
+
+	w = (zwriter*)malloc(sizeof(zwriter));
+#ifdef Z_EXHAUST_EXIT
+	CHECKMALLOCEXIT(w);
+#else
+	if (w == NULL) {
+		return NULL;
+	}
+#endif
+	w->buf = (zbyte*)malloc(bufsize);
+#ifdef Z_EXHAUST_EXIT
+	CHECKMALLOCEXIT(w->buf);
+#else
+	if (w->buf == NULL) {
+		free(w);
+		return NULL;
+	}
+#endif
+	w->fd = fd;
+	w->flags = flags;
+	w->bufsize = bufsize;
+	w->buflen = 0;
+	w->niov = 0;
+	w->stats.bytes = 0;
+	w->stats.syscalls = 0;
+	return w;
+}
+
+/**
+ * Write out everything queued, without the fsync() policy.
+ */
+static void
+write_queued(zwriter*const w)
+{
+	struct iovec* iov = w->iov;
+	int cnt = w->niov;
+	ssize_t res;
+
+	while (cnt > 0) {
+		res = writev(w->fd, iov, cnt);
+		w->stats.syscalls++;
+		if (res < 0) {
+			runtime_assert(errno == EINTR, "writev() failed.");
+			continue;
+		}
+		w->stats.bytes += res;
+		/* Skip whatever was written, which may end partway through an iovec. */
+		while ((cnt > 0) && ((size_t)res >= iov->iov_len)) {
+			res -= iov->iov_len;
+			iov++;
+			cnt--;
+		}
+		if (cnt > 0) {
+			iov->iov_base = (char*)iov->iov_base + res;
+			iov->iov_len -= res;
+		}
+	}
+	w->niov = 0;
+	w->buflen = 0;
+}
+
+static void
+do_fsync(zwriter*const w)
+{
+	int res = fsync(w->fd);
+	w->stats.syscalls++;
+	runtime_assert((res == 0) || (errno == EINVAL) || (errno == EROFS), "fsync() failed.");
+}
+
+static void
+push_copy(zwriter*const w, const zbyte*const p, const size_t len)
+{
+	zbyte* dst;
+	struct iovec* last;
+	assert (len <= w->bufsize); /* error internal to this module */
+
+	if ((w->buflen + len > w->bufsize) || (w->niov == IOV_MAX))
+		write_queued(w);
+	dst = w->buf + w->buflen;
+	memcpy(dst, p, len);
+	w->buflen += len;
+
+	/* Extend the previous iovec if it ends where this copy begins. */
+	last = (w->niov > 0) ? &w->iov[w->niov - 1] : NULL;
+	if ((last != NULL) && ((zbyte*)last->iov_base + last->iov_len == dst)) {
+		last->iov_len += len;
+	} else {
+		w->iov[w->niov].iov_base = dst;
+		w->iov[w->niov].iov_len = len;
+		w->niov++;
+	}
+}
+
+static void
+push_ref(zwriter*const w, const zbyte*const p, const size_t len)
+{
+	if (w->niov == IOV_MAX)
+		write_queued(w);
+	w->iov[w->niov].iov_base = (void*)p;
+	w->iov[w->niov].iov_len = len;
+	w->niov++;
+}
+
+void
+zw_write(zwriter*const w, const czstr cz)
+{
+	assert (w != NULL); /* @precondition */
+	if (cz.len == 0)
+		return;
+	if (cz.len < ZW_COPY_MAX)
+		push_copy(w, cz.buf, cz.len);
+	else
+		push_ref(w, cz.buf, cz.len);
+}
+
+void
+zw_encode(zwriter*const w, const czstr cz)
+{
+	zbyte len[4];
+	assert (w != NULL); /* @precondition */
+	uint32_encode(cz.len, len);
+	push_copy(w, len, 4);
+	zw_write(w, cz);
+}
+
+void
+zw_flush(zwriter*const w)
+{
+	assert (w != NULL); /* @precondition */
+	write_queued(w);
+	if (w->flags & ZW_SYNC_ON_FLUSH)
+		do_fsync(w);
+}
+
+void
+zw_sync(zwriter*const w)
+{
+	assert (w != NULL); /* @precondition */
+	write_queued(w);
+	do_fsync(w);
+}
+
+zwriter_stats
+zw_stats(const zwriter*const w)
+{
+	assert (w != NULL); /* @precondition */
+	return w->stats;
+}
+
+void
+free_zwriter(zwriter*const w)
+{
+	assert (w != NULL); /* @precondition */
+	zw_flush(w);
+	free(w->buf);
+	free(w);
+}
+
+/**
+ * Copyright (c) 2002-2004 Bryce "Zooko" Wilcox-O'Hearn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software to deal in this software without restriction, including
+ * without limitation the rights to use, modify, distribute, sublicense, and/or
+ * sell copies of this software, and to permit persons to whom this software is
+ * furnished to do so, provided that the above copyright notice and this
+ * permission notice is included in all copies or substantial portions of this
+ * software. THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED.
+ */
@@ -0,0 +1,115 @@
+/**
+ * copyright 2002-2004 Bryce "Zooko" Wilcox-O'Hearn
+ * mailto:zooko@zooko.com
+ *
+ * See the end of this file for the simple, permissive free software, open
+ * source license.
+ *
+ * About this module:
+ *
+ * cz_to_stream() and z_encode() make one stdio fwrite() call per string.  Each
+ * call takes the FILE's lock and copies the string into the FILE's buffer, so
+ * writing millions of small strings costs millions of lock round-trips and
+ * copies.  A zwriter writes to a raw file descriptor instead.  It copies
+ * strings shorter than ZW_COPY_MAX into its own buffer, but only queues a
+ * reference to each longer string.  zw_flush() then writes everything queued
+ * with as few writev() calls as possible.
+ *
+ * Because long strings are not copied, their bytes must stay valid and
+ * unchanged until the next zw_flush(), zw_sync() or free_zwriter() returns.
+ * (zw_write() and zw_encode() may also flush, when the zwriter fills up, but
+ * that only ends the wait sooner.)
+ *
+ * Errors from writev() raise an error with runtime_assert(), as fwrite()
+ * errors do in cz_to_stream().
+ */
+#ifndef _INCL_zwriter_h
+#define _INCL_zwriter_h
+
+#include "zstr.h"
+
+/** Strings at least this long are queued by reference instead of copied. */
+#define ZW_COPY_MAX 1024
+
+/** Flag for new_zwriter(): fsync() after every flush. */
+#define ZW_SYNC_ON_FLUSH 1
+
+typedef struct zwriter zwriter; /* opaque */
+
+typedef struct {
+	unsigned long long bytes; /* bytes written to the fd so far */
+	unsigned long long syscalls; /* writev() and fsync() calls so far */
+} zwriter_stats;
+
+/**
+ * Allocates a zwriter which writes to fd.  It does not take ownership of fd:
+ * free_zwriter() does not close() it.
+ *
+ * @param bufsize the size of the buffer that short strings are copied into
+ * @param flags 0, or ZW_SYNC_ON_FLUSH
+ *
+ * On  malloc failure (if not Z_EXHAUST_EXIT) then it will return NULL.
+ *
+ * @precondition fd must be >= 0.
+ * @precondition bufsize must be at least ZW_COPY_MAX.
+ */
+zwriter*
+new_zwriter(int fd, size_t bufsize, int flags);
+
+/**
+ * Queue the contents of cz to be written (like cz_to_stream()).
+ */
+void
+zw_write(zwriter* w, czstr cz);
+
+/**
+ * Queue a big-endian 4-byte length followed by the contents of cz to be
+ * written (like z_encode()).
+ */
+void
+zw_encode(zwriter* w, czstr cz);
+
+/**
+ * Write everything queued so far, then fsync() if the zwriter was made with
+ * ZW_SYNC_ON_FLUSH.
+ */
+void
+zw_flush(zwriter* w);
+
+/**
+ * Write everything queued so far, then fsync() regardless of flags.  (If fd
+ * is a pipe or socket, which cannot be fsync()ed, then this is the same as
+ * zw_flush().)
+ */
+void
+zw_sync(zwriter* w);
+
+/**
+ * @return the counts of bytes written and system calls made so far.
+ */
+zwriter_stats
+zw_stats(const zwriter* w);
+
+/**
+ * Flush, then free the zwriter.
+ *
+ * @precondition w must not be NULL.
+ */
+void
+free_zwriter(zwriter* w);
+
+#endif /* #ifndef _INCL_zwriter_h */
+
+
+/**
+ * Copyright (c) 2002-2004 Bryce "Zooko" Wilcox-O'Hearn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software to deal in this software without restriction, including
+ * without limitation the rights to use, modify, distribute, sublicense, and/or
+ * sell copies of this software, and to permit persons to whom this software is
+ * furnished to do so, provided that the above copyright notice and this
+ * permission notice is included in all copies or substantial portions of this
+ * software. THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED.
+ */